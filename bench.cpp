@@ -0,0 +1,415 @@
+/**
+ * @file bench.cpp
+ * @brief SlipStreamBench - replays synthetic or recorded BGRA sequences through each AV1 backend and the packetizer
+ * @copyright 2025-2026 Daniel Chrobak
+ */
+
+#include "common.hpp"
+#include "encoder.hpp"
+#include "convert.hpp"
+#include "packetizer.hpp"
+#include "webrtc.hpp"
+#include "loopback.hpp"
+
+// Sessions list monitors on auth; the bench has none to offer
+std::vector<MonitorInfo> g_monitors;
+std::mutex g_monitorsMutex;
+
+struct BenchOptions {
+    int width = 1920, height = 1080, fps = 60, frames = 600, fecGroup = 0;
+    int64_t bitrate = 20000000;
+    bool realtime = false, loopback = false;
+    LinkProfile link;
+    std::vector<std::string> codecs{std::begin(AV1Encoder::CODECS), std::end(AV1Encoder::CODECS)};
+    std::vector<std::string> workloads = {"text", "video", "static"};
+    std::string input, jsonPath;
+};
+
+struct BenchResult {
+    std::string codec, workload;
+    bool hardware = false;
+    std::vector<int64_t> encUs;
+    std::vector<size_t> chunks;
+    uint64_t bytes = 0, parity = 0, keyframes = 0, failed = 0;
+    size_t maxKeyChunks = 0;
+};
+
+struct LoopbackResult {
+    std::string codec, workload;
+    uint64_t encoded = 0, keyframes = 0, forcedKeys = 0, sent = 0, serverDrops = 0, linkLost = 0;
+    int64_t finalBps = 0;
+    double seconds = 0;
+    LoopbackClient::Stats client;
+};
+
+std::vector<std::string> Split(const std::string& s) {
+    std::vector<std::string> out;
+    for (size_t b = 0, e; b <= s.size(); b = e + 1) {
+        e = s.find(',', b);
+        if (e == std::string::npos) e = s.size();
+        if (e > b) out.push_back(s.substr(b, e - b));
+    }
+    return out;
+}
+
+std::string CodecName(const std::string& s) {
+    static const std::unordered_map<std::string, std::string> aliases = {
+        {"nvenc", "av1_nvenc"}, {"qsv", "av1_qsv"}, {"amf", "av1_amf"}, {"svt", "libsvtav1"}, {"aom", "libaom-av1"}};
+    auto it = aliases.find(s);
+    return it != aliases.end() ? it->second : s;
+}
+
+// Cheap to generate, but each pattern loads the encoder the way its real counterpart does:
+// static is a desktop with a blinking caret, text scrolls a page of glyph strokes, video changes every pixel every frame
+class Workload {
+private:
+    std::string kind;
+    int width, height;
+    std::vector<uint8_t> page;
+    std::ifstream file;
+    uint32_t seed = 0x9E3779B9;
+
+    static void Fill(std::vector<uint8_t>& buf, int stride, int x0, int y0, int w, int h, uint32_t bgra) {
+        for (int y = y0; y < y0 + h; y++) for (int x = x0; x < x0 + w; x++) memcpy(&buf[(static_cast<size_t>(y) * stride + x) * 4], &bgra, 4);
+    }
+
+    uint32_t Rand() { seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5; return seed; }
+
+    void BuildDesktop() {
+        page.assign(static_cast<size_t>(width) * height * 4, 0);
+        Fill(page, width, 0, 0, width, height, 0xFF2B4A6F);
+        Fill(page, width, 0, height - 48, width, 48, 0xFF1E1E1E);
+        for (int i = 0; i < 3; i++) {
+            int x = width / 10 + i * width / 5, y = height / 10 + i * height / 8, w = width / 2, h = height / 2;
+            Fill(page, width, x, y, w, h, 0xFFF3F3F3);
+            Fill(page, width, x, y, w, 32, i == 2 ? 0xFF0063B1 : 0xFFCCCCCC);
+        }
+    }
+
+    // Four screens of text lines on white so the scroll wraps rarely
+    void BuildTextPage() {
+        int pageHeight = height * 4;
+        page.assign(static_cast<size_t>(width) * pageHeight * 4, 0xFF);
+        for (int line = 24; line + 16 < pageHeight; line += 22)
+            for (int x = 40; x < width - 40;) {
+                int word = 3 + Rand() % 9;
+                for (int c = 0; c < word && x < width - 40; c++, x += 9)
+                    for (int s = 0; s < 3; s++) Fill(page, width, x + Rand() % 6, line + Rand() % 12, 1 + Rand() % 2, 2 + Rand() % 6, 0xFF202020);
+                x += 9;
+            }
+    }
+
+public:
+    Workload(const std::string& k, int w, int h, const std::string& input) : kind(k), width(w), height(h) {
+        if (kind == "static") BuildDesktop();
+        else if (kind == "text") BuildTextPage();
+        else if (kind == "recorded") { file.open(input, std::ios::binary); if (!file) throw std::runtime_error("Cannot open " + input); }
+        else if (kind != "video") throw std::runtime_error("Unknown workload " + kind);
+    }
+
+    const char* GetName() const { return kind.c_str(); }
+
+    void Next(int index, std::vector<uint8_t>& out) {
+        size_t frameBytes = static_cast<size_t>(width) * height * 4;
+        out.resize(frameBytes);
+        if (kind == "static") {
+            memcpy(out.data(), page.data(), frameBytes);
+            if ((index / 30) % 2) Fill(out, width, width / 10 + 60, height / 10 + 60, 2, 18, 0xFF000000);
+        } else if (kind == "text") {
+            // Scrolls 6 rows per frame, about what a wheel flick produces at 60 fps
+            int pageHeight = height * 4, top = (index * 6) % (pageHeight - height);
+            memcpy(out.data(), page.data() + static_cast<size_t>(top) * width * 4, frameBytes);
+        } else if (kind == "video") {
+            for (int y = 0; y < height; y++) {
+                uint8_t* row = out.data() + static_cast<size_t>(y) * width * 4;
+                for (int x = 0; x < width; x++) {
+                    uint32_t n = Rand() & 0x0F;
+                    row[x * 4 + 0] = static_cast<uint8_t>(((x + index * 3) ^ (y - index)) + n);
+                    row[x * 4 + 1] = static_cast<uint8_t>(((x >> 1) + (y >> 1) + index * 2) + n);
+                    row[x * 4 + 2] = static_cast<uint8_t>((((x - width / 2) * (x - width / 2) + (y - height / 2) * (y - height / 2)) >> 9) - index * 4);
+                    row[x * 4 + 3] = 0xFF;
+                }
+            }
+        } else {
+            // Raw BGRA frames back to back, looped when the recording runs out
+            if (!file.read(reinterpret_cast<char*>(out.data()), frameBytes)) { file.clear(); file.seekg(0); file.read(reinterpret_cast<char*>(out.data()), frameBytes); }
+        }
+    }
+};
+
+class BenchDevice {
+private:
+    ID3D11Device* device = nullptr;
+    ID3D11DeviceContext* context = nullptr;
+    ID3D11Multithread* multithread = nullptr;
+    ID3D11Texture2D* source = nullptr;
+    ID3D11Texture2D* pool = nullptr;
+    GPUSync gpuSync;
+    VideoConverter converter;
+    int width, height;
+
+public:
+    static constexpr int POOL_SIZE = 8;
+
+    BenchDevice(int w, int h) : width(w), height(h) {
+        UINT flags = D3D11_CREATE_DEVICE_BGRA_SUPPORT | D3D11_CREATE_DEVICE_VIDEO_SUPPORT;
+        D3D_FEATURE_LEVEL levels[] = {D3D_FEATURE_LEVEL_12_1, D3D_FEATURE_LEVEL_12_0, D3D_FEATURE_LEVEL_11_1, D3D_FEATURE_LEVEL_11_0};
+        if (FAILED(D3D11CreateDevice(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr, flags, levels, _countof(levels), D3D11_SDK_VERSION, &device, nullptr, &context)))
+            throw std::runtime_error("Failed to create D3D11 device");
+        if (SUCCEEDED(device->QueryInterface(IID_PPV_ARGS(&multithread)))) multithread->SetMultithreadProtected(TRUE);
+        if (!gpuSync.Init(device, context)) throw std::runtime_error("Failed to initialize GPU synchronization");
+
+        D3D11_TEXTURE2D_DESC sd = {static_cast<UINT>(w), static_cast<UINT>(h), 1, 1, DXGI_FORMAT_B8G8R8A8_UNORM, {1, 0}, D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET, 0, 0};
+        if (FAILED(device->CreateTexture2D(&sd, nullptr, &source))) throw std::runtime_error("Failed to create source texture");
+        // Same layout as the capture pool, so every backend sees exactly what it gets from ScreenCapture
+        D3D11_TEXTURE2D_DESC pd = {static_cast<UINT>(w), static_cast<UINT>(h), 1, POOL_SIZE, DXGI_FORMAT_NV12, {1, 0}, D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET, 0, 0};
+        if (FAILED(device->CreateTexture2D(&pd, nullptr, &pool)) || !converter.Init(device, context, pool, POOL_SIZE, w, h, false))
+            throw std::runtime_error("Failed to create video conversion pool");
+    }
+
+    ~BenchDevice() { SafeRelease(pool, source, multithread, context, device); }
+
+    void Upload(const std::vector<uint8_t>& bgra, int slice) {
+        MTLock lock(multithread);
+        context->UpdateSubresource(source, 0, nullptr, bgra.data(), width * 4, 0);
+        converter.Convert(source, slice);
+        context->Flush();
+    }
+
+    std::unique_ptr<AV1Encoder> CreateEncoder(const std::string& codec, int fps, int64_t bitrate) {
+        EncoderSettings cfg; cfg.codec = codec;
+        return std::make_unique<AV1Encoder>(width, height, fps, device, context, multithread, &gpuSync, pool, POOL_SIZE, bitrate, cfg);
+    }
+
+    ID3D11Texture2D* GetPool() const { return pool; }
+};
+
+BenchResult RunOne(BenchDevice& dev, const BenchOptions& opt, const std::string& codec, Workload& work) {
+    BenchResult r{codec, work.GetName()};
+    // Outlives the encoder, whose teardown may still release slices it holds
+    std::atomic<uint32_t> busy{0};
+    auto encoder = dev.CreateEncoder(codec, opt.fps, opt.bitrate);
+    r.hardware = encoder->IsHardware();
+    Packetizer packetizer;
+    uint32_t frameId = 0;
+    const int64_t epochUs = GetTimestamp();
+    std::vector<uint8_t> bgra;
+    EncodedFrame out;
+
+    auto record = [&] {
+        r.encUs.push_back(out.encUs);
+        r.bytes += out.data.size();
+        auto res = packetizer.Packetize(out, frameId++, static_cast<size_t>(opt.fecGroup), epochUs, [](rtc::binary&, bool) { return true; });
+        r.chunks.push_back(res.chunks);
+        r.parity += res.parity;
+        if (out.isKey) { r.keyframes++; r.maxKeyChunks = std::max(r.maxKeyChunks, res.chunks); }
+    };
+
+    auto start = steady_clock::now();
+    for (int i = 0; i < opt.frames; i++) {
+        if (opt.realtime) std::this_thread::sleep_until(start + microseconds(static_cast<int64_t>(i) * 1000000 / opt.fps));
+        int slice = i % BenchDevice::POOL_SIZE;
+        // Hardware encoders hold a slice until the surface is consumed; wait for it like the capture pool would
+        for (auto t = steady_clock::now(); busy.load() & (1u << slice);) {
+            if (steady_clock::now() - t > 1s) throw std::runtime_error("Encoder never released a pool slice");
+            std::this_thread::yield();
+        }
+        work.Next(i, bgra);
+        dev.Upload(bgra, slice);
+        busy.fetch_or(1u << slice);
+        out.Clear();
+        bool ok = encoder->Encode(dev.GetPool(), slice, static_cast<int64_t>(i) * 1000000 / opt.fps, i == 0, out, [&busy, slice] { busy.fetch_and(~(1u << slice)); });
+        if (ok) record();
+    }
+    while (encoder->HasPending()) { out.Clear(); if (encoder->EncodePending(out)) record(); }
+    r.failed = encoder->GetFailed();
+    return r;
+}
+
+// Real sessions, queues, congestion control and drop logic against the headless viewer, paced like the capture loop
+LoopbackResult RunLoopback(BenchDevice& dev, const BenchOptions& opt, const std::string& codec, Workload& work) {
+    LoopbackResult r{codec, work.GetName()};
+    std::atomic<uint32_t> busy{0};
+    auto encoder = dev.CreateEncoder(codec, opt.fps, CongestionController::START_BITRATE);
+    WebRTCServer server;
+    server.SetAuthCredentials("bench", "000000");
+    server.SetLinkProfile(opt.link);
+    LoopbackClient client("bench", "000000", opt.fps, opt.link);
+
+    std::string answer = server.HandleOffer(client.Offer());
+    if (answer.empty()) throw std::runtime_error("Server rejected the loopback offer");
+    if (size_t p = answer.find("a=setup:actpass"); p != std::string::npos) answer.replace(p, 15, "a=setup:active");
+    client.Accept(answer);
+    if (!client.WaitStreaming(5s)) throw std::runtime_error("Loopback viewer never started streaming");
+
+    std::vector<uint8_t> bgra;
+    EncodedFrame out;
+    auto start = steady_clock::now();
+    for (int i = 0; i < opt.frames; i++) {
+        std::this_thread::sleep_until(start + microseconds(static_cast<int64_t>(i) * 1000000 / opt.fps));
+        int slice = i % BenchDevice::POOL_SIZE;
+        for (auto t = steady_clock::now(); busy.load() & (1u << slice);) {
+            if (steady_clock::now() - t > 1s) throw std::runtime_error("Encoder never released a pool slice");
+            std::this_thread::yield();
+        }
+        int64_t ts = GetTimestamp();
+        work.Next(i, bgra);
+        dev.Upload(bgra, slice);
+        if (server.ShouldSkipFrame()) continue;
+
+        bool key = server.NeedsKey(0);
+        if (key && i) r.forcedKeys++;
+        encoder->SetBitrate(server.GetTargetBitrate(0));
+        busy.fetch_or(1u << slice);
+        out.Clear();
+        if (!encoder->Encode(dev.GetPool(), slice, ts, key, out, [&busy, slice] { busy.fetch_and(~(1u << slice)); })) { if (key && !encoder->HasPending()) server.RequestKeyframe(0); continue; }
+        r.encoded++; r.keyframes += out.isKey;
+        server.Send(out);
+    }
+    r.seconds = duration<double>(steady_clock::now() - start).count();
+    // Let the link and the sender queue empty before counting
+    std::this_thread::sleep_for(milliseconds(std::max(300, opt.link.delayMs * 2 + opt.link.jitterMs * 2 + 200)));
+
+    auto stats = server.GetStats();
+    r.sent = stats.sent; r.serverDrops = stats.dropped + stats.skipped; r.finalBps = server.GetTargetBitrate(0);
+    r.client = client.GetStats();
+    return r;
+}
+
+int64_t Percentile(std::vector<int64_t> v, double p) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, static_cast<size_t>(p * v.size()))];
+}
+
+void PrintResult(const BenchResult& r, int fps) {
+    double seconds = r.encUs.empty() ? 0.0 : static_cast<double>(r.encUs.size()) / fps, chunks = 0;
+    for (size_t c : r.chunks) chunks += static_cast<double>(c);
+    printf("%-11s %-8s %-2s %6zu %4llu | %6.2f %6.2f %6.2f %6.2f ms | %7.2f Mbps | %6.1f %5zu chunks | %3llu key %5zu | %llu parity\n",
+           r.codec.c_str(), r.workload.c_str(), r.hardware ? "HW" : "SW", r.encUs.size(), r.failed,
+           Percentile(r.encUs, 0.50) / 1000.0, Percentile(r.encUs, 0.95) / 1000.0, Percentile(r.encUs, 0.99) / 1000.0, Percentile(r.encUs, 1.0) / 1000.0,
+           seconds > 0 ? r.bytes * 8.0 / seconds / 1e6 : 0.0, r.chunks.empty() ? 0.0 : chunks / r.chunks.size(),
+           r.chunks.empty() ? size_t(0) : *std::max_element(r.chunks.begin(), r.chunks.end()), r.keyframes, r.maxKeyChunks, r.parity);
+}
+
+json ToJson(const BenchResult& r, int fps) {
+    double seconds = static_cast<double>(r.encUs.size()) / fps;
+    uint64_t chunks = 0;
+    for (size_t c : r.chunks) chunks += c;
+    return {{"codec", r.codec}, {"workload", r.workload}, {"hardware", r.hardware}, {"frames", r.encUs.size()}, {"failed", r.failed},
+            {"encodeUs", {{"p50", Percentile(r.encUs, 0.50)}, {"p95", Percentile(r.encUs, 0.95)}, {"p99", Percentile(r.encUs, 0.99)}, {"max", Percentile(r.encUs, 1.0)}}},
+            {"mbps", seconds > 0 ? r.bytes * 8.0 / seconds / 1e6 : 0.0}, {"bytes", r.bytes}, {"keyframes", r.keyframes},
+            {"chunks", {{"total", chunks}, {"max", r.chunks.empty() ? size_t(0) : *std::max_element(r.chunks.begin(), r.chunks.end())}, {"maxKey", r.maxKeyChunks}, {"parity", r.parity}}}};
+}
+
+void PrintLoopback(const LoopbackResult& r) {
+    const auto& c = r.client;
+    double rate = r.encoded ? 100.0 * c.complete / r.encoded : 0.0;
+    printf("%-11s %-8s %6llu %6.1f%% %6.1f%% | drop %4llu/%4llu | key %4.2f/s (%llu forced) | NACK %4llu FEC %4llu | %6.2f %6.2f %6.2f ms | %5.1f Mbps\n",
+           r.codec.c_str(), r.workload.c_str(), r.encoded, rate, r.encoded ? 100.0 * c.decoded / r.encoded : 0.0, r.serverDrops, c.dropped,
+           r.seconds > 0 ? (c.keyRequests + r.forcedKeys) / r.seconds : 0.0, r.forcedKeys, c.nacks, c.fecRecovered,
+           Percentile(c.latencyUs, 0.50) / 1000.0, Percentile(c.latencyUs, 0.95) / 1000.0, Percentile(c.latencyUs, 0.99) / 1000.0, r.finalBps / 1e6);
+}
+
+json ToJson(const LoopbackResult& r, const LinkProfile& link) {
+    const auto& c = r.client;
+    return {{"codec", r.codec}, {"workload", r.workload},
+            {"link", {{"lossPct", link.lossPct}, {"delayMs", link.delayMs}, {"jitterMs", link.jitterMs}, {"bandwidthBps", link.bandwidthBps}}},
+            {"encoded", r.encoded}, {"keyframes", r.keyframes}, {"sent", r.sent}, {"complete", c.complete}, {"decoded", c.decoded},
+            {"completionRate", r.encoded ? static_cast<double>(c.complete) / r.encoded : 0.0},
+            {"drops", {{"server", r.serverDrops}, {"client", c.dropped}, {"waitingKey", c.waitingKey}}},
+            {"keyRequests", {{"client", c.keyRequests}, {"forced", r.forcedKeys}, {"perSecond", r.seconds > 0 ? (c.keyRequests + r.forcedKeys) / r.seconds : 0.0}}},
+            {"nacks", c.nacks}, {"lossReports", c.lossReports}, {"fecRecovered", c.fecRecovered}, {"chunks", c.chunks}, {"chunksLost", c.chunksLost},
+            {"latencyUs", {{"p50", Percentile(c.latencyUs, 0.50)}, {"p95", Percentile(c.latencyUs, 0.95)}, {"p99", Percentile(c.latencyUs, 0.99)}, {"max", Percentile(c.latencyUs, 1.0)}}},
+            {"finalBitrateBps", r.finalBps}};
+}
+
+bool ParseArgs(int argc, char** argv, BenchOptions& opt) {
+    bool workloadsSet = false;
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        const char* v = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (a == "--realtime") { opt.realtime = true; continue; }
+        if (a == "--loopback") { opt.loopback = true; continue; }
+        if (!v) { ERR("Missing value for %s", a.c_str()); return false; }
+        i++;
+        if (a == "--codec") { opt.codecs.clear(); for (auto& c : Split(v)) opt.codecs.push_back(CodecName(c)); }
+        else if (a == "--workload") { opt.workloads = Split(v); workloadsSet = true; }
+        else if (a == "--frames") opt.frames = std::max(1, atoi(v));
+        else if (a == "--fps") opt.fps = std::clamp(atoi(v), 1, 240);
+        else if (a == "--bitrate") opt.bitrate = static_cast<int64_t>(std::max(0.1, atof(v)) * 1e6);
+        else if (a == "--fec") opt.fecGroup = std::clamp(atoi(v), 0, 255);
+        else if (a == "--size") { if (sscanf(v, "%dx%d", &opt.width, &opt.height) != 2 || opt.width < 64 || opt.height < 64) { ERR("Bad size %s", v); return false; } }
+        else if (a == "--input") opt.input = v;
+        else if (a == "--json") opt.jsonPath = v;
+        else if (a == "--loss") opt.link.lossPct = std::clamp(atof(v), 0.0, 100.0);
+        else if (a == "--delay") opt.link.delayMs = std::max(0, atoi(v));
+        else if (a == "--jitter") opt.link.jitterMs = std::max(0, atoi(v));
+        else if (a == "--bandwidth") opt.link.bandwidthBps = static_cast<int64_t>(std::max(0.0, atof(v)) * 1e6);
+        else { ERR("Unknown option %s", a.c_str()); return false; }
+    }
+    opt.width &= ~1; opt.height &= ~1;
+    if (!opt.input.empty() && !workloadsSet) opt.workloads = {"recorded"};
+    return true;
+}
+
+int RunLoopbackSuite(BenchDevice& dev, const BenchOptions& opt) {
+    std::vector<LoopbackResult> results;
+    for (const auto& w : opt.workloads) {
+        for (const auto& codec : opt.codecs) {
+            Workload work(w, opt.width, opt.height, opt.input);
+            try { results.push_back(RunLoopback(dev, opt, codec, work)); }
+            catch (const std::exception& e) { WARN("%s/%s skipped: %s", codec.c_str(), w.c_str(), e.what()); }
+        }
+    }
+
+    const LinkProfile& l = opt.link;
+    char bw[32] = "uncapped";
+    if (l.bandwidthBps) snprintf(bw, sizeof(bw), "%.1f Mbps", l.bandwidthBps / 1e6);
+    printf("\n%dx%d @ %d fps, %d frames, link: %.1f%% loss, %d+%d ms, %s\n", opt.width, opt.height, opt.fps, opt.frames, l.lossPct, l.delayMs, l.jitterMs, bw);
+    printf("%-11s %-8s %6s %7s %7s | %14s | %24s | %17s | %20s | %s\n", "codec", "workload", "frames", "done", "decoded", "drop srv/cli", "key requests", "repair", "e2e p50/p95/p99", "final");
+    for (const auto& r : results) PrintLoopback(r);
+
+    if (!opt.jsonPath.empty()) {
+        json out = json::array();
+        for (const auto& r : results) out.push_back(ToJson(r, opt.link));
+        std::ofstream f(opt.jsonPath);
+        if (!(f << out.dump(2))) { ERR("Failed to write %s", opt.jsonPath.c_str()); return 1; }
+    }
+    return results.empty() ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    BenchOptions opt;
+    if (!ParseArgs(argc, argv, opt)) {
+        puts("Usage: SlipStreamBench [--codec nvenc,qsv,amf,svt,aom] [--workload text,video,static,recorded] [--frames N]\n"
+             "                       [--size WxH] [--fps N] [--bitrate Mbps] [--fec group] [--input frames.bgra] [--json out.json] [--realtime]\n"
+             "                       [--loopback [--loss pct] [--delay ms] [--jitter ms] [--bandwidth Mbps]]");
+        return 2;
+    }
+
+    try {
+        BenchDevice dev(opt.width, opt.height);
+        if (opt.loopback) return RunLoopbackSuite(dev, opt);
+        std::vector<BenchResult> results;
+        for (const auto& w : opt.workloads) {
+            for (const auto& codec : opt.codecs) {
+                Workload work(w, opt.width, opt.height, opt.input);
+                try { results.push_back(RunOne(dev, opt, codec, work)); }
+                catch (const std::exception& e) { WARN("%s/%s skipped: %s", codec.c_str(), w.c_str(), e.what()); }
+            }
+        }
+
+        printf("\n%dx%d @ %d fps, %.1f Mbps target, %d frames, FEC group %d\n", opt.width, opt.height, opt.fps, opt.bitrate / 1e6, opt.frames, opt.fecGroup);
+        printf("%-11s %-8s %-2s %6s %4s | %6s %6s %6s %6s    | %12s | %12s chunks | key/chunks\n", "codec", "workload", "", "frames", "fail", "p50", "p95", "p99", "max", "bitrate", "avg/max");
+        for (const auto& r : results) PrintResult(r, opt.fps);
+
+        if (!opt.jsonPath.empty()) {
+            json out = json::array();
+            for (const auto& r : results) out.push_back(ToJson(r, opt.fps));
+            std::ofstream f(opt.jsonPath);
+            if (!(f << out.dump(2))) { ERR("Failed to write %s", opt.jsonPath.c_str()); return 1; }
+        }
+        return results.empty() ? 1 : 0;
+    } catch (const std::exception& e) { ERR("Fatal: %s", e.what()); return 1; }
+}
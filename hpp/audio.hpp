@@ -8,55 +8,117 @@
 #include "common.hpp"
 #include <mmdeviceapi.h>
 #include <audioclient.h>
+#include <immintrin.h>
 
 extern "C" {
 #include <opus/opus.h>
 }
 
 struct AudioPacket {
-    std::vector<uint8_t> data;
+    static constexpr int MAX_BYTES = 4000;
+    uint8_t data[MAX_BYTES];
+    int size = 0, samples = 0;
     int64_t ts = 0;
-    int samples = 0;
+    void Clear() { size = samples = 0; ts = 0; }
 };
 
 class AudioCapture {
 private:
+    // Mirrored: every frame is stored RING_FRAMES apart as well, so any unread window is contiguous for the kernels
+    static constexpr uint64_t RING_FRAMES = 16384;
+
     IMMDeviceEnumerator* enumerator = nullptr;
     IMMDevice* device = nullptr;
     IAudioClient* audioClient = nullptr;
     IAudioCaptureClient* captureClient = nullptr;
     OpusEncoder* opusEncoder = nullptr;
     WAVEFORMATEX* waveFormat = nullptr;
+    HANDLE samplesReady = nullptr;
+
+    static constexpr int MAX_FRAME_US = 20000;
+
+    struct Settings { int frameUs = MAX_FRAME_US, kbps = 128; bool fec = false, dtx = false; };
 
-    int sampleRate = 48000, channels = 2, frameDurationMs = 20;
-    int frameSamples = 0, opusSampleRate = 48000;
+    int sampleRate = 48000, channels = 2, sourceChannels = 2;
+    int opusFrameSamples = 0, opusSampleRate = 48000, application = OPUS_APPLICATION_RESTRICTED_LOWDELAY;
+    Settings active, pending;
+    std::mutex settingsMutex;
+    std::atomic<bool> settingsChanged{false};
 
     std::atomic<bool> running{false}, capturing{false};
     std::thread captureThread;
-    std::queue<AudioPacket> packetQueue;
-    std::mutex queueMutex;
-    std::condition_variable queueCondition;
-    std::vector<float> resampleBuffer;
+    SlotRing<AudioPacket, 16> packets;
+    std::atomic<uint64_t> droppedPackets{0};
+    std::vector<float> ring;
+    uint64_t written = 0;             // frames
+    uint64_t readPos = 0, step = 0;   // 32.32 fixed-point source frame position of the next output frame, and its increment
     std::vector<int16_t> encodeBuffer;
-    std::vector<uint8_t> outputBuffer;
+
+    static float Fraction(uint64_t pos) { return static_cast<float>(static_cast<uint32_t>(pos)) * (1.0f / 4294967296.0f); }
+
+    static __m128i Quantize(__m128 a, __m128 b) {
+        const __m128 lo = _mm_set1_ps(-1.0f), hi = _mm_set1_ps(1.0f), scale = _mm_set1_ps(32767.0f);
+        return _mm_packs_epi32(_mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(a, lo), hi), scale)),
+                               _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(b, lo), hi), scale)));
+    }
+
+    // Truncates like the scalar cast, so the vector and tail paths agree sample for sample
+    static void ToInt16(const float* s, int16_t* d, int n) {
+        int i = 0;
+        for (; i + 8 <= n; i += 8) _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i), Quantize(_mm_loadu_ps(s + i), _mm_loadu_ps(s + i + 4)));
+        for (; i < n; i++) d[i] = static_cast<int16_t>(std::clamp(s[i], -1.0f, 1.0f) * 32767.0f);
+    }
+
+    // Linear interpolation at fixed-point positions; stereo runs two frames per vector, anything else stays scalar
+    static void Resample(const float* s, uint64_t pos, uint64_t step, int ch, int16_t* d, int frames) {
+        int i = 0;
+        if (ch == 2) {
+            auto pair = [&](uint64_t p0, uint64_t p1) {
+                const float *a = s + (p0 >> 32) * 2, *b = s + (p1 >> 32) * 2;
+                __m128 x = _mm_loadh_pi(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(a))), reinterpret_cast<const __m64*>(b));
+                __m128 y = _mm_loadh_pi(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(a + 2))), reinterpret_cast<const __m64*>(b + 2));
+                float f0 = Fraction(p0), f1 = Fraction(p1);
+                return _mm_add_ps(x, _mm_mul_ps(_mm_sub_ps(y, x), _mm_setr_ps(f0, f0, f1, f1)));
+            };
+            for (; i + 4 <= frames; i += 4, pos += 4 * step)
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i * 2), Quantize(pair(pos, pos + step), pair(pos + 2 * step, pos + 3 * step)));
+        }
+        for (; i < frames; i++, pos += step) {
+            const float* a = s + (pos >> 32) * ch;
+            float f = Fraction(pos);
+            for (int c = 0; c < ch; c++) d[i * ch + c] = static_cast<int16_t>(std::clamp(a[c] + (a[c + ch] - a[c]) * f, -1.0f, 1.0f) * 32767.0f);
+        }
+    }
+
+    // Capture thread only: opus_encoder_ctl must not race opus_encode
+    void ApplySettings(const Settings& s) {
+        // In-band FEC lives in SILK, which the restricted low-delay application leaves out
+        int app = s.fec ? OPUS_APPLICATION_AUDIO : OPUS_APPLICATION_RESTRICTED_LOWDELAY;
+        if (app != application && opus_encoder_init(opusEncoder, opusSampleRate, channels, app) == OPUS_OK) application = app;
+        opus_encoder_ctl(opusEncoder, OPUS_SET_BITRATE(s.kbps * 1000));
+        opus_encoder_ctl(opusEncoder, OPUS_SET_COMPLEXITY(5));
+        opus_encoder_ctl(opusEncoder, OPUS_SET_SIGNAL(OPUS_SIGNAL_MUSIC));
+        opus_encoder_ctl(opusEncoder, OPUS_SET_INBAND_FEC(s.fec ? 1 : 0));
+        opus_encoder_ctl(opusEncoder, OPUS_SET_PACKET_LOSS_PERC(s.fec ? 10 : 0));
+        opus_encoder_ctl(opusEncoder, OPUS_SET_DTX(s.dtx ? 1 : 0));
+        opusFrameSamples = static_cast<int>(static_cast<int64_t>(opusSampleRate) * s.frameUs / 1000000);
+        active = s;
+    }
 
     void CaptureLoop() {
         SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
         CoInitializeEx(nullptr, COINIT_MULTITHREADED);
 
         while (running) {
-            if (!capturing) {
-                std::this_thread::sleep_for(10ms);
-                continue;
-            }
+            // Loopback stops signalling while nothing plays, and older systems never signal it at all, so the wait
+            // times out at half a frame and drains anyway
+            DWORD waitMs = std::max(1, active.frameUs / 2000);
+            if (samplesReady) WaitForSingleObject(samplesReady, waitMs);
+            else std::this_thread::sleep_for(std::chrono::milliseconds(waitMs));
+            if (!capturing) continue;
 
             UINT32 packetLength = 0;
-            if (FAILED(captureClient->GetNextPacketSize(&packetLength))) {
-                std::this_thread::sleep_for(100ms);
-                continue;
-            }
-
-            while (packetLength > 0 && running && capturing) {
+            while (running && capturing && SUCCEEDED(captureClient->GetNextPacketSize(&packetLength)) && packetLength > 0) {
                 BYTE* data = nullptr;
                 UINT32 numFrames = 0;
                 DWORD flags = 0;
@@ -66,63 +128,51 @@ private:
                     break;
 
                 if (!(flags & AUDCLNT_BUFFERFLAGS_SILENT) && data && numFrames > 0)
-                    ProcessAudio(data, numFrames, GetTimestamp());
+                    ProcessAudio(reinterpret_cast<const float*>(data), numFrames, GetTimestamp());
 
                 captureClient->ReleaseBuffer(numFrames);
-                if (FAILED(captureClient->GetNextPacketSize(&packetLength)))
-                    break;
             }
-
-            std::this_thread::sleep_for(std::chrono::milliseconds(frameDurationMs / 2));
         }
 
         CoUninitialize();
     }
 
-    void ProcessAudio(BYTE* data, UINT32 numFrames, int64_t timestamp) {
-        auto* floatData = reinterpret_cast<float*>(data);
-        resampleBuffer.insert(resampleBuffer.end(), floatData, floatData + numFrames * channels);
-
-        const int opusFrameSamples = opusSampleRate * frameDurationMs / 1000;
-        size_t consumed = 0;
-
-        while (resampleBuffer.size() - consumed >= static_cast<size_t>(frameSamples * channels)) {
-            const float* src = resampleBuffer.data() + consumed;
-
-            if (sampleRate != opusSampleRate) {
-                const double ratio = static_cast<double>(sampleRate) / opusSampleRate;
-                for (int i = 0; i < opusFrameSamples * channels; i++) {
-                    double srcIdx = (i / channels) * ratio * channels + (i % channels);
-                    int idx0 = static_cast<int>(srcIdx);
-                    float fraction = static_cast<float>(srcIdx - idx0);
-                    float sample = src[idx0] * (1.0f - fraction) +
-                                   src[std::min(idx0 + channels, frameSamples * channels - 1)] * fraction;
-                    encodeBuffer[i] = static_cast<int16_t>(std::clamp(sample, -1.0f, 1.0f) * 32767.0f);
-                }
-            } else {
-                for (int i = 0; i < frameSamples * channels; i++)
-                    encodeBuffer[i] = static_cast<int16_t>(std::clamp(src[i], -1.0f, 1.0f) * 32767.0f);
-            }
-
-            consumed += frameSamples * channels;
-
-            int encodedBytes = opus_encode(opusEncoder, encodeBuffer.data(), opusFrameSamples,
-                                           outputBuffer.data(), static_cast<opus_int32>(outputBuffer.size()));
-
-            if (encodedBytes > 0) {
-                std::lock_guard<std::mutex> lock(queueMutex);
-                if (packetQueue.size() < 50) {
-                    packetQueue.push({
-                        std::vector<uint8_t>(outputBuffer.begin(), outputBuffer.begin() + encodedBytes),
-                        timestamp, opusFrameSamples
-                    });
-                }
-                queueCondition.notify_one();
-            }
+    // Keeps the first two channels of whatever the mix format carries
+    void Append(const float* data, UINT32 numFrames) {
+        for (UINT32 i = 0; i < numFrames; i++, written++) {
+            float* dst = ring.data() + (written % RING_FRAMES) * channels;
+            for (int c = 0; c < channels; c++) dst[c] = dst[c + RING_FRAMES * channels] = data[i * sourceChannels + c];
         }
+    }
 
-        if (consumed > 0)
-            resampleBuffer.erase(resampleBuffer.begin(), resampleBuffer.begin() + consumed);
+    void ProcessAudio(const float* data, UINT32 numFrames, int64_t timestamp) {
+        if (settingsChanged.exchange(false)) {
+            Settings s;
+            { std::lock_guard<std::mutex> lock(settingsMutex); s = pending; }
+            ApplySettings(s);
+            LOG("Audio: %.1fms frames, %dkbps%s%s", s.frameUs / 1000.0, s.kbps, s.fec ? ", FEC" : "", s.dtx ? ", DTX" : "");
+        }
+        Append(data, numFrames);
+        // Interpolation reads one frame past the last position it lands on
+        auto needed = [&] { return ((readPos + (opusFrameSamples - 1) * step) >> 32) + 2 - (readPos >> 32); };
+        if (written - (readPos >> 32) > RING_FRAMES - needed()) readPos = (written - (RING_FRAMES - needed())) << 32;
+
+        while (written - (readPos >> 32) >= needed()) {
+            uint64_t base = readPos >> 32;
+            const float* src = ring.data() + (base % RING_FRAMES) * channels;
+            if (step == 1ULL << 32) ToInt16(src, encodeBuffer.data(), opusFrameSamples * channels);
+            else Resample(src, readPos - (base << 32), step, channels, encodeBuffer.data(), opusFrameSamples);
+            readPos += opusFrameSamples * step;
+
+            // Encoded straight into the ring slot audioThread sends from; with every slot still queued the packet is lost
+            AudioPacket* pkt = packets.Acquire();
+            if (!pkt) { droppedPackets++; continue; }
+            pkt->size = opus_encode(opusEncoder, encodeBuffer.data(), opusFrameSamples, pkt->data, AudioPacket::MAX_BYTES);
+            // Under DTX a one or two byte packet only says "still silent" and need not be sent
+            if (pkt->size <= 0 || (active.dtx && pkt->size <= 2)) continue;
+            pkt->ts = timestamp; pkt->samples = opusFrameSamples;
+            packets.Commit();
+        }
     }
 
 public:
@@ -145,14 +195,24 @@ public:
         check(audioClient->GetMixFormat(&waveFormat), "Failed to get mix format");
 
         sampleRate = waveFormat->nSamplesPerSec;
-        channels = std::min(static_cast<int>(waveFormat->nChannels), 2);
-        frameSamples = sampleRate * frameDurationMs / 1000;
+        sourceChannels = waveFormat->nChannels;
+        channels = std::min(sourceChannels, 2);
 
         LOG("Audio: %dHz, %d channels", sampleRate, channels);
 
-        check(audioClient->Initialize(AUDCLNT_SHAREMODE_SHARED, AUDCLNT_STREAMFLAGS_LOOPBACK,
-                                      200000, 0, waveFormat, nullptr),
-              "Failed to initialize audio client");
+        if (SUCCEEDED(audioClient->Initialize(AUDCLNT_SHAREMODE_SHARED, AUDCLNT_STREAMFLAGS_LOOPBACK | AUDCLNT_STREAMFLAGS_EVENTCALLBACK,
+                                              200000, 0, waveFormat, nullptr))) {
+            samplesReady = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+            if (!samplesReady || FAILED(audioClient->SetEventHandle(samplesReady))) { if (samplesReady) CloseHandle(samplesReady); samplesReady = nullptr; }
+        } else {
+            SafeRelease(audioClient);
+            check(device->Activate(__uuidof(IAudioClient), CLSCTX_ALL, nullptr, reinterpret_cast<void**>(&audioClient)),
+                  "Failed to activate audio client");
+            check(audioClient->Initialize(AUDCLNT_SHAREMODE_SHARED, AUDCLNT_STREAMFLAGS_LOOPBACK,
+                                          200000, 0, waveFormat, nullptr),
+                  "Failed to initialize audio client");
+            WARN("Event-driven audio capture unavailable, polling");
+        }
         check(audioClient->GetService(__uuidof(IAudioCaptureClient),
                                       reinterpret_cast<void**>(&captureClient)),
               "Failed to get capture client");
@@ -165,13 +225,10 @@ public:
         if (opusError != OPUS_OK)
             throw std::runtime_error("Failed to create Opus encoder");
 
-        opus_encoder_ctl(opusEncoder, OPUS_SET_BITRATE(128000));
-        opus_encoder_ctl(opusEncoder, OPUS_SET_COMPLEXITY(5));
-        opus_encoder_ctl(opusEncoder, OPUS_SET_SIGNAL(OPUS_SIGNAL_MUSIC));
-
-        encodeBuffer.resize(opusSampleRate * frameDurationMs / 1000 * channels);
-        outputBuffer.resize(4000);
-        resampleBuffer.reserve(frameSamples * channels * 8);
+        ApplySettings(active);
+        step = (static_cast<uint64_t>(sampleRate) << 32) / opusSampleRate;
+        encodeBuffer.resize(opusSampleRate / 1000 * MAX_FRAME_US / 1000 * channels);
+        ring.resize(RING_FRAMES * 2 * channels);
 
         LOG("Audio initialized (Opus %dHz)", opusSampleRate);
         CoUninitialize();
@@ -181,6 +238,7 @@ public:
         Stop();
         if (opusEncoder) opus_encoder_destroy(opusEncoder);
         if (waveFormat) CoTaskMemFree(waveFormat);
+        if (samplesReady) CloseHandle(samplesReady);
         SafeRelease(captureClient, audioClient, device, enumerator);
     }
 
@@ -198,22 +256,26 @@ public:
     void Stop() {
         if (!running) return;
         running = capturing = false;
-        queueCondition.notify_all();
+        if (samplesReady) SetEvent(samplesReady);
+        packets.Wake();
         if (captureThread.joinable()) captureThread.join();
         if (audioClient) audioClient->Stop();
     }
 
-    bool PopPacket(AudioPacket& out, int timeoutMs = 10) {
-        std::unique_lock<std::mutex> lock(queueMutex);
-        if (!queueCondition.wait_for(lock, std::chrono::milliseconds(timeoutMs),
-                                     [this] { return !packetQueue.empty() || !running; }))
-            return false;
-        if (packetQueue.empty()) return false;
-        out = std::move(packetQueue.front());
-        packetQueue.pop();
+    // Takes effect before the next packet; false for a frame length Opus cannot encode
+    bool Configure(int frameUs, int kbps, bool fec, bool dtx) {
+        if (frameUs != 2500 && frameUs != 5000 && frameUs != 10000 && frameUs != MAX_FRAME_US) return false;
+        std::lock_guard<std::mutex> lock(settingsMutex);
+        pending = {frameUs, std::clamp(kbps, 6, 510), fec, dtx};
+        settingsChanged = true;
         return true;
     }
 
+    // The packet stays valid until ReleasePacket()
+    const AudioPacket* PeekPacket(DWORD timeoutMs = 10) { return packets.Peek(timeoutMs); }
+    void ReleasePacket() { packets.Release(); }
+
+    uint64_t GetDroppedPackets() const { return droppedPackets; }
     int GetSampleRate() const { return opusSampleRate; }
     int GetChannels() const { return channels; }
 };
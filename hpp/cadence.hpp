@@ -0,0 +1,46 @@
+/**
+ * @file cadence.hpp
+ * @brief Phase-locks capture deadlines to the controlling viewer's display refresh
+ * @copyright 2025-2026 Daniel Chrobak
+ */
+
+#pragma once
+#include "common.hpp"
+
+#pragma pack(push, 1)
+// vsync is a recent rAF tick and lead the capture-to-decoded time, both on this host's clock; depth is x100
+struct PresentReportMsg { uint32_t magic; int64_t vsyncUs; uint32_t periodUs, leadUs; uint16_t depth; };
+#pragma pack(pop)
+
+// A frame decoded just after the viewer's vsync waits most of a refresh to be shown. Capture deadlines are nudged so
+// that, after the reported lead, frames finish decoding MARGIN_US ahead of a vsync instead.
+class FrameCadence {
+private:
+    static constexpr int64_t MARGIN_US = 2000, MAX_STEP_US = 500, STALE_US = 3000000;
+    // Above one queued decode on average the viewer is behind, and timing arrivals to its refresh gains nothing
+    static constexpr int MAX_DEPTH = 100;
+
+    std::mutex mutex;
+    int64_t vsyncUs = 0, periodUs = 0, leadUs = 0, reportedAt = 0;
+    int depth = 0;
+
+public:
+    void OnReport(const PresentReportMsg& r) {
+        if (r.periodUs < 2000 || r.periodUs > 100000) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        vsyncUs = r.vsyncUs; periodUs = r.periodUs; leadUs = r.leadUs; depth = r.depth;
+        reportedAt = GetTimestamp();
+    }
+
+    void Reset() { std::lock_guard<std::mutex> lock(mutex); reportedAt = 0; }
+
+    // Moves a deadline at most MAX_STEP_US toward the locked phase, so lock is gained without skipping frames.
+    // Streams faster than the viewer's refresh are left alone: every other frame is never shown on time anyway.
+    int64_t Align(int64_t deadline, int64_t intervalUs) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!reportedAt || GetTimestamp() - reportedAt > STALE_US || depth > MAX_DEPTH || intervalUs * 10 < periodUs * 9) return deadline;
+        int64_t err = ((vsyncUs - MARGIN_US - leadUs - deadline) % periodUs + periodUs) % periodUs;
+        if (err > periodUs / 2) err -= periodUs;
+        return deadline + std::clamp(err, -MAX_STEP_US, MAX_STEP_US);
+    }
+};
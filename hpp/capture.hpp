@@ -6,134 +6,121 @@
 
 #pragma once
 #include "common.hpp"
+#include "dirty.hpp"
+#include "gpusync.hpp"
+#include "convert.hpp"
+#include "trace.hpp"
 
 struct FrameData {
     ID3D11Texture2D* tex = nullptr;
     int64_t ts = 0;
     uint64_t fence = 0;
     int poolIdx = -1;
+    bool diffed = false, forceDirty = false, lowReady = false;
 
     void Release() { SafeRelease(tex); poolIdx = -1; }
 };
 
+// Latest-wins handoff of pool slices from the capture callback to the encode thread, without locks. Each slice is
+// counted while anything may still read it: the mailbox, the diff reference and frames the encoder holds. Only the
+// capture thread takes a slice up from zero, so a free slice is provably unread. RepeatLastFrame may post from
+// another thread, hence the CAS on the mailbox.
 class FrameSlot {
-private:
-    FrameData slots[3];
-    int writeIdx = 0, readIdx = -1;
-    CRITICAL_SECTION cs;
-    HANDLE event;
-    uint64_t dropCount = 0;
-    std::atomic<uint32_t> inFlightMask{0};
-
 public:
-    FrameSlot() { InitializeCriticalSection(&cs); event = CreateEventW(nullptr, TRUE, FALSE, nullptr); }
-    ~FrameSlot() { DeleteCriticalSection(&cs); CloseHandle(event); for (auto& s : slots) s.Release(); }
-
-    void Push(ID3D11Texture2D* tex, int64_t ts, uint64_t fence, int poolIdx = -1) {
-        EnterCriticalSection(&cs);
-        int idx = writeIdx;
-        writeIdx = (writeIdx + 1) % 3;
-        if (writeIdx == readIdx) writeIdx = (writeIdx + 1) % 3;
-
-        if (slots[idx].poolIdx >= 0) inFlightMask.fetch_and(~(1u << slots[idx].poolIdx));
-        slots[idx].Release();
-        tex->AddRef();
-        slots[idx] = {tex, ts, fence, poolIdx};
-        if (poolIdx >= 0) inFlightMask.fetch_or(1u << poolIdx);
-        if (readIdx >= 0) dropCount++;
-        readIdx = idx;
+    static constexpr int MAX_SLICES = 16;
+
+private:
+    static constexpr int WRITING = 1 << 16;
+    static constexpr uint32_t SLICE_MASK = 0xFF, FORCE_DIRTY = 1 << 8, REPEAT = 1 << 9;
+
+    // Written only while the slice is held WRITING, so readers holding a count see it unchanged
+    struct Meta { ID3D11Texture2D* tex = nullptr; int64_t ts = 0; uint64_t fence = 0; bool diffed = false, lowReady = false; };
+    Meta meta[MAX_SLICES];
+    std::atomic<int> refs[MAX_SLICES] = {};
+    std::atomic<uint32_t> mailbox{0};  // slice + 1 of the newest unconsumed frame, plus flags
+    std::atomic<int> reference{-1};    // last slice written: the next diff's base and what a repeat re-posts
+    int next = 0;
+    HANDLE event = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+    std::atomic<uint64_t> dropCount{0};
+
+    void Post(int idx, uint32_t flags) {
+        uint32_t old = mailbox.load(), word;
+        // A dropped frame was diffed against but never encoded, so its changes must ride along with this one
+        do word = (idx + 1) | flags | (old ? FORCE_DIRTY : 0); while (!mailbox.compare_exchange_weak(old, word));
+        if (old) { dropCount++; MarkReleased((old & SLICE_MASK) - 1); }
         SetEvent(event);
-        LeaveCriticalSection(&cs);
     }
 
-    bool Pop(FrameData& out, DWORD timeoutMs = 8) {
-        if (WaitForSingleObject(event, timeoutMs) != WAIT_OBJECT_0) return false;
-        EnterCriticalSection(&cs);
-        ResetEvent(event);
-        if (readIdx < 0) { LeaveCriticalSection(&cs); return false; }
-        out = slots[readIdx];
-        slots[readIdx].tex = nullptr;
-        slots[readIdx].poolIdx = -1;
-        readIdx = -1;
-        LeaveCriticalSection(&cs);
-        return true;
-    }
+public:
+    ~FrameSlot() { CloseHandle(event); for (auto& m : meta) SafeRelease(m.tex); }
 
-    void MarkReleased(int idx) { if (idx >= 0) inFlightMask.fetch_and(~(1u << idx)); }
-    bool IsInFlight(int idx) const { return idx >= 0 && (inFlightMask.load() & (1u << idx)); }
+    FrameSlot() = default;
+    FrameSlot(const FrameSlot&) = delete;
+    FrameSlot& operator=(const FrameSlot&) = delete;
 
-    void Reset() {
-        EnterCriticalSection(&cs);
-        inFlightMask = 0;
-        for (auto& s : slots) s.Release();
-        writeIdx = 0; readIdx = -1;
-        ResetEvent(event);
-        LeaveCriticalSection(&cs);
+    // A slice nothing reads, held for writing until Publish or Abandon; -1 when the encoder holds them all
+    int Acquire(int count) {
+        for (int i = 0; i < count; i++) {
+            int idx = (next + i) % count, expected = 0;
+            if (refs[idx].compare_exchange_strong(expected, WRITING)) { next = idx + 1; return idx; }
+        }
+        return -1;
     }
 
-    uint64_t GetDropped() {
-        EnterCriticalSection(&cs);
-        uint64_t c = dropCount; dropCount = 0;
-        LeaveCriticalSection(&cs);
-        return c;
+    void Abandon(int idx) { refs[idx] -= WRITING; }
+
+    // The write hold becomes the mailbox's count plus the reference's, and the old reference is let go.
+    // lowReady says the half-size pool slice was converted from this frame too.
+    void Publish(ID3D11Texture2D* tex, int idx, int64_t ts, uint64_t fence, bool diffed, bool lowReady) {
+        Meta& m = meta[idx];
+        if (m.tex != tex) { SafeRelease(m.tex); tex->AddRef(); m.tex = tex; }
+        m.ts = ts; m.fence = fence; m.diffed = diffed; m.lowReady = lowReady;
+        refs[idx] += 2 - WRITING;
+        MarkReleased(reference.exchange(idx));
+        Post(idx, 0);
     }
 
-    HANDLE GetEvent() const { return event; }
-};
-
-class GPUSync {
-private:
-    ID3D11Device5* device5 = nullptr;
-    ID3D11DeviceContext4* context4 = nullptr;
-    ID3D11Fence* fence = nullptr;
-    ID3D11Query* query = nullptr;
-    HANDLE fenceEvent = nullptr;
-    uint64_t fenceValue = 0;
-    bool useFence = false;
-
-public:
-    bool Init(ID3D11Device* device, ID3D11DeviceContext* context) {
-        if (SUCCEEDED(device->QueryInterface(IID_PPV_ARGS(&device5))) &&
-            SUCCEEDED(context->QueryInterface(IID_PPV_ARGS(&context4))) &&
-            SUCCEEDED(device5->CreateFence(0, D3D11_FENCE_FLAG_SHARED, IID_PPV_ARGS(&fence)))) {
-            fenceEvent = CreateEventW(nullptr, FALSE, FALSE, nullptr);
-            useFence = true;
-            LOG("GPU sync: Fence");
-            return true;
+    // Re-posts the reference slice; the count is taken by CAS so a slice freed and rewritten meanwhile is never posted
+    bool Repeat() {
+        while (true) {
+            int idx = reference;
+            if (idx < 0) return false;
+            int r = refs[idx];
+            if (r > 0 && !(r & WRITING) && refs[idx].compare_exchange_weak(r, r + 1)) { Post(idx, REPEAT); return true; }
         }
-        SafeRelease(device5, context4, fence);
-        D3D11_QUERY_DESC qd = {D3D11_QUERY_EVENT, 0};
-        if (SUCCEEDED(device->CreateQuery(&qd, &query))) { LOG("GPU sync: Query"); return true; }
-        return false;
     }
 
-    ~GPUSync() { if (fenceEvent) CloseHandle(fenceEvent); SafeRelease(fence, context4, device5, query); }
+    int GetReference() const { return reference; }
 
-    uint64_t Signal(ID3D11DeviceContext* context) {
-        if (useFence && context4 && fence) { context4->Signal(fence, ++fenceValue); return fenceValue; }
-        if (query) context->End(query);
-        return 0;
+    bool Pop(FrameData& out, DWORD timeoutMs = 8) {
+        uint32_t word = mailbox.exchange(0);
+        if (!word && (WaitForSingleObject(event, timeoutMs) != WAIT_OBJECT_0 || !(word = mailbox.exchange(0)))) return false;
+        int idx = (word & SLICE_MASK) - 1;
+        const Meta& m = meta[idx];
+        m.tex->AddRef();
+        // A repeat carries no diff of its own, so it is always treated as changed
+        out = {m.tex, word & REPEAT ? GetTimestamp() : m.ts, m.fence, idx, !(word & REPEAT) && m.diffed, (word & FORCE_DIRTY) != 0, m.lowReady};
+        return true;
     }
 
-    bool IsComplete(uint64_t value, ID3D11DeviceContext* context) {
-        return useFence ? (!fence || fence->GetCompletedValue() >= value)
-                        : (!query || context->GetData(query, nullptr, 0, 0) == S_OK);
-    }
+    void MarkReleased(int idx) { if (idx >= 0) refs[idx]--; }
 
-    bool Wait(uint64_t value, ID3D11DeviceContext* context, DWORD timeoutMs = 5) {
-        if (IsComplete(value, context)) return true;
-        if (useFence && fence && fenceEvent) {
-            fence->SetEventOnCompletion(value, fenceEvent);
-            return WaitForSingleObject(fenceEvent, timeoutMs) == WAIT_OBJECT_0 || IsComplete(value, context);
-        }
-        for (DWORD i = 0; i < 200 && !IsComplete(value, context); i++) YieldProcessor();
-        return IsComplete(value, context);
+    // Frames the encoder still holds keep their slices counted and come back through MarkReleased as usual
+    void Reset() {
+        if (uint32_t word = mailbox.exchange(0)) MarkReleased((word & SLICE_MASK) - 1);
+        MarkReleased(reference.exchange(-1));
+        next = 0;
     }
+
+    uint64_t GetDropped() const { return dropCount; }
+
+    HANDLE GetEvent() const { return event; }
 };
 
 class ScreenCapture {
 private:
-    static constexpr int TEX_POOL_SIZE = 8;
+    static constexpr int TEX_POOL_SIZE = 8, LOW_LAYER_MIN_WIDTH = 1280;
+    static_assert(TEX_POOL_SIZE <= FrameSlot::MAX_SLICES);
 
     ID3D11Device* device = nullptr;
     ID3D11DeviceContext* context = nullptr;
@@ -144,30 +131,29 @@ private:
     WGC::Direct3D11CaptureFramePool framePool{nullptr};
     WGC::GraphicsCaptureSession captureSession{nullptr};
 
-    ID3D11Texture2D* texturePool[TEX_POOL_SIZE] = {};
-    int textureIndex = 0, width = 0, height = 0, hostFps = 60;
+    ID3D11Texture2D* texturePool = nullptr;
+    ID3D11Texture2D* lowPool = nullptr;
+    // Pools of the last size left behind, taken back on a return to it so the encoder that adopted them can be reused
+    struct PoolSet { ID3D11Texture2D *pool, *low; int width, height, lowWidth, lowHeight; bool hdr; };
+    static constexpr size_t SPARE_POOLS = 1;
+    std::deque<PoolSet> sparePools;
+    int width = 0, height = 0, lowWidth = 0, lowHeight = 0, hostFps = 60;
 
     std::atomic<int> targetFps{60}, currentMonitorIdx{0};
     GPUSync gpuSync;
+    VideoConverter converter, lowConverter;
+    DirtyTracker dirtyTracker;
     FrameSlot* frameSlot;
 
-    std::atomic<bool> running{true}, capturing{false}, forceSync{true}, sessionStarted{false};
-    bool supportsMinInterval = false;
+    std::atomic<bool> running{true}, capturing{false}, forceSync{true}, sessionStarted{false}, lowEnabled{false};
+    bool supportsMinInterval = false, trackDirty = false, hdr = false;
     int64_t nextFrameTime = 0;
     HMONITOR currentMonitor = nullptr;
     std::mutex captureMutex;
     std::function<void(int, int, int)> onResolutionChange;
+    std::function<int64_t(int64_t, int64_t)> alignDeadline;
     std::atomic<uint64_t> textureConflicts{0};
 
-    int FindAvailableTexture() {
-        for (int i = 0; i < TEX_POOL_SIZE; i++) {
-            int idx = (textureIndex + i) % TEX_POOL_SIZE;
-            if (!frameSlot->IsInFlight(idx)) { textureIndex = idx + 1; return idx; }
-        }
-        textureConflicts++;
-        return textureIndex++ % TEX_POOL_SIZE;
-    }
-
     void OnFrameArrived(WGC::Direct3D11CaptureFramePool const& sender, winrt::Windows::Foundation::IInspectable const&) {
         auto frame = sender.TryGetNextFrame();
         if (!frame || !running || !capturing) return;
@@ -179,6 +165,11 @@ private:
         else if (timestamp < nextFrameTime) return;
 
         while (nextFrameTime <= timestamp) nextFrameTime += interval;
+        // Only a display refreshing faster than the stream leaves a choice of which frame to take
+        if (alignDeadline && hostFps > targetFps) nextFrameTime = std::max(alignDeadline(nextFrameTime, interval), timestamp + interval / 2);
+        static thread_local bool named = (Trace::NameThread("capture"), true);
+        (void)named;
+        Trace::Record(Trace::WgcArrival, timestamp, timestamp);
 
         auto surface = frame.Surface();
         if (!surface) return;
@@ -187,11 +178,24 @@ private:
         auto access = surface.as<::Windows::Graphics::DirectX::Direct3D11::IDirect3DDxgiInterfaceAccess>();
         if (FAILED(access->GetInterface(IID_PPV_ARGS(sourceTexture.put()))) || !sourceTexture) return;
 
-        int texIdx = FindAvailableTexture();
-        if (!texturePool[texIdx]) return;
-
-        { MTLock lock(multithread); context->CopyResource(texturePool[texIdx], sourceTexture.get()); context->Flush(); }
-        frameSlot->Push(texturePool[texIdx], timestamp, gpuSync.Signal(context), texIdx);
+        if (!texturePool) return;
+        // Every slice still read by the encoder: this frame is skipped rather than overwriting one
+        int texIdx = frameSlot->Acquire(TEX_POOL_SIZE);
+        if (texIdx < 0) { textureConflicts++; return; }
+
+        bool diffed = false, low = false;
+        uint64_t fence = 0;
+        {
+            MTLock lock(multithread);
+            if (!converter.Convert(sourceTexture.get(), texIdx)) { frameSlot->Abandon(texIdx); return; }
+            low = lowEnabled && lowPool && lowConverter.Convert(sourceTexture.get(), texIdx);
+            int ref = frameSlot->GetReference();
+            if (trackDirty && ref >= 0) diffed = dirtyTracker.Dispatch(context, texIdx, ref);
+            fence = gpuSync.Signal(context);
+            context->Flush();
+        }
+        Trace::Mark(Trace::PoolConvert, timestamp);
+        frameSlot->Publish(texturePool, texIdx, timestamp, fence, diffed, low);
     }
 
     void InitializeMonitor(HMONITOR monitor) {
@@ -205,24 +209,57 @@ private:
                                              winrt::put_abi(captureItem))))
             throw std::runtime_error("Failed to create capture item for monitor");
 
+        if (texturePool) {
+            sparePools.push_front({texturePool, lowPool, width, height, lowWidth, lowHeight, hdr});
+            texturePool = lowPool = nullptr;
+            if (sparePools.size() > SPARE_POOLS) { SafeRelease(sparePools.back().pool, sparePools.back().low); sparePools.pop_back(); }
+        }
         width = captureItem.Size().Width;
         height = captureItem.Size().Height;
 
-        for (auto& tex : texturePool) SafeRelease(tex);
+        // Single NV12 (P010 on HDR) array the encoder adopts as its hwframes pool; the video processor converts into each slice
+        bool wantHdr = VideoConverter::IsHdrMonitor(device, monitor);
+        auto spare = std::find_if(sparePools.begin(), sparePools.end(), [&](const PoolSet& s) { return s.width == width && s.height == height && s.hdr == wantHdr; });
+        if (spare != sparePools.end()) {
+            texturePool = spare->pool; lowPool = spare->low; lowWidth = spare->lowWidth; lowHeight = spare->lowHeight; hdr = spare->hdr;
+            sparePools.erase(spare);
+            if (!converter.Init(device, context, texturePool, TEX_POOL_SIZE, width, height, hdr) ||
+                (lowPool && !lowConverter.Init(device, context, lowPool, TEX_POOL_SIZE, width, height, hdr, lowWidth, lowHeight)))
+                SafeRelease(texturePool, lowPool);
+        }
+        for (bool tryHdr : {wantHdr, false}) {
+            if (texturePool) break;
+            if (!tryHdr && wantHdr) WARN("HDR conversion unsupported, falling back to 8-bit");
+            SafeRelease(texturePool);
+            D3D11_TEXTURE2D_DESC td = {
+                static_cast<UINT>(width), static_cast<UINT>(height), 1, TEX_POOL_SIZE, tryHdr ? DXGI_FORMAT_P010 : DXGI_FORMAT_NV12,
+                {1, 0}, D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET, 0, 0
+            };
+            if (SUCCEEDED(device->CreateTexture2D(&td, nullptr, &texturePool)) &&
+                converter.Init(device, context, texturePool, TEX_POOL_SIZE, width, height, tryHdr)) { hdr = tryHdr; break; }
+            SafeRelease(texturePool);
+            if (!tryHdr) throw std::runtime_error("Failed to create video conversion pool");
+        }
+
+        // Half-size copy of every slice for the simulcast low layer, filled by a second scaling blit
+        if (!lowPool) lowWidth = lowHeight = 0;
+        if (!lowPool && width >= LOW_LAYER_MIN_WIDTH) {
+            D3D11_TEXTURE2D_DESC pd; texturePool->GetDesc(&pd);
+            pd.Width = (width / 2) & ~1; pd.Height = (height / 2) & ~1;
+            if (SUCCEEDED(device->CreateTexture2D(&pd, nullptr, &lowPool)) &&
+                lowConverter.Init(device, context, lowPool, TEX_POOL_SIZE, width, height, hdr, pd.Width, pd.Height)) { lowWidth = pd.Width; lowHeight = pd.Height; }
+            else { SafeRelease(lowPool); WARN("Low layer pool unavailable, simulcast disabled"); }
+        }
 
-        D3D11_TEXTURE2D_DESC td = {
-            static_cast<UINT>(width), static_cast<UINT>(height), 1, 1, DXGI_FORMAT_B8G8R8A8_UNORM,
-            {1, 0}, D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET, 0, D3D11_RESOURCE_MISC_SHARED
-        };
-        for (int i = 0; i < TEX_POOL_SIZE; i++)
-            if (FAILED(device->CreateTexture2D(&td, nullptr, &texturePool[i])))
-                throw std::runtime_error("Failed to create texture pool");
+        trackDirty = dirtyTracker.Init(device, texturePool, TEX_POOL_SIZE, width, height);
+        if (!trackDirty) WARN("Dirty region tracking unavailable, encoding every frame");
 
         framePool = WGC::Direct3D11CaptureFramePool::CreateFreeThreaded(
-            winrtDevice, WGD::DirectXPixelFormat::B8G8R8A8UIntNormalized, 2, {width, height});
+            winrtDevice, hdr ? WGD::DirectXPixelFormat::R16G16B16A16Float : WGD::DirectXPixelFormat::B8G8R8A8UIntNormalized, 2, {width, height});
         framePool.FrameArrived({this, &ScreenCapture::OnFrameArrived});
         captureSession = framePool.CreateCaptureSession(captureItem);
-        captureSession.IsCursorCaptureEnabled(true);
+        // The cursor travels as its own message (cursor.hpp), so moving it alone never produces a frame
+        captureSession.IsCursorCaptureEnabled(false);
         try { captureSession.IsBorderRequired(false); } catch (...) {}
 
         sessionStarted = false;
@@ -269,27 +306,54 @@ public:
         LOG("Capture initialized: %dx%d @ %dHz", width, height, hostFps);
     }
 
+    // Another monitor on the same D3D11 device, with its own pools, fence and frame slot
+    ScreenCapture(FrameSlot* slot, const ScreenCapture& shared, int monitorIndex) : frameSlot(slot) {
+        winrt::init_apartment(winrt::apartment_type::multi_threaded);
+        device = shared.device; context = shared.context; multithread = shared.multithread;
+        device->AddRef(); context->AddRef(); if (multithread) multithread->AddRef();
+        winrtDevice = shared.winrtDevice;
+        supportsMinInterval = shared.supportsMinInterval;
+
+        if (!gpuSync.Init(device, context))
+            throw std::runtime_error("Failed to initialize GPU synchronization");
+
+        HMONITOR mon;
+        {
+            std::lock_guard<std::mutex> lock(g_monitorsMutex);
+            if (monitorIndex < 0 || monitorIndex >= static_cast<int>(g_monitors.size())) throw std::runtime_error("No such monitor");
+            mon = g_monitors[monitorIndex].hMon;
+        }
+        InitializeMonitor(mon);
+        currentMonitorIdx = monitorIndex;
+        LOG("Capture initialized for monitor %d: %dx%d @ %dHz", monitorIndex, width, height, hostFps);
+    }
+
     ~ScreenCapture() {
         running = capturing = false;
         try { if (captureSession) captureSession.Close(); } catch (...) {}
         try { if (framePool) framePool.Close(); } catch (...) {}
-        for (auto& tex : texturePool) SafeRelease(tex);
-        SafeRelease(multithread, context, device);
+        for (auto& s : sparePools) SafeRelease(s.pool, s.low);
+        SafeRelease(lowPool, texturePool, multithread, context, device);
         winrt::uninit_apartment();
     }
 
     void SetResolutionChangeCallback(std::function<void(int, int, int)> cb) { onResolutionChange = cb; }
+    // Given the next capture deadline and the frame interval, returns the deadline to use instead
+    void SetDeadlineCallback(std::function<int64_t(int64_t, int64_t)> cb) { alignDeadline = cb; }
 
     void StartCapture() {
         std::lock_guard<std::mutex> lock(captureMutex);
         if (capturing) return;
-        frameSlot->Reset(); textureIndex = 0; forceSync = true;
+        frameSlot->Reset(); forceSync = true;
         ApplyMinUpdateInterval();
         if (!sessionStarted.exchange(true)) captureSession.StartCapture();
         capturing = true;
         LOG("Capture started at %dHz", hostFps);
     }
 
+    // Re-queues the last converted frame, so a viewer joining a static screen still gets its keyframe
+    void RepeatLastFrame() { if (capturing && texturePool) frameSlot->Repeat(); }
+
     void PauseCapture() { if (capturing) { capturing = false; LOG("Capture paused"); } }
 
     bool SwitchMonitor(int index) {
@@ -305,7 +369,7 @@ public:
         try { if (captureSession) captureSession.Close(); } catch (...) {}
         try { if (framePool) framePool.Close(); } catch (...) {}
         captureSession = nullptr; framePool = nullptr; captureItem = nullptr;
-        frameSlot->Reset(); textureIndex = 0;
+        frameSlot->Reset();
 
         try {
             InitializeMonitor(g_monitors[index].hMon);
@@ -338,7 +402,18 @@ public:
     bool IsCapturing() const { return capturing; }
     bool IsReady(uint64_t fence) { return gpuSync.IsComplete(fence, context); }
     bool WaitReady(uint64_t fence) { return gpuSync.Wait(fence, context); }
-    uint64_t GetTexConflicts() { return textureConflicts.exchange(0); }
+    int ReadDirtyRegions(int poolIdx, std::vector<RECT>& rects) { MTLock lock(multithread); return dirtyTracker.Read(context, poolIdx, width, height, rects); }
+    int GetTileCount() const { return dirtyTracker.GetTileCount(); }
+    uint64_t GetTexConflicts() const { return textureConflicts; }
+    GPUSync* GetSync() { return &gpuSync; }
+    ID3D11Texture2D* GetPool() const { return texturePool; }
+    // Same slice indexing and fence as the main pool; only written while enabled
+    ID3D11Texture2D* GetLowPool() const { return lowPool; }
+    int GetLowW() const { return lowWidth; }
+    int GetLowH() const { return lowHeight; }
+    void SetLowLayerEnabled(bool enabled) { lowEnabled = enabled; }
+    int GetPoolSize() const { return TEX_POOL_SIZE; }
+    int GetBitDepth() const { return hdr ? 10 : 8; }
     ID3D11Device* GetDev() const { return device; }
     ID3D11DeviceContext* GetCtx() const { return context; }
     ID3D11Multithread* GetMT() const { return multithread; }
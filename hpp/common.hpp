@@ -60,7 +60,12 @@ enum MsgType : uint32_t {
     MSG_MONITOR_SET   = 0x4D4F4E53, MSG_AUDIO_DATA    = 0x41554449,
     MSG_MOUSE_MOVE    = 0x4D4F5645, MSG_MOUSE_BTN     = 0x4D42544E,
     MSG_MOUSE_WHEEL   = 0x4D57484C, MSG_KEY           = 0x4B455920,
-    MSG_AUTH_REQUEST  = 0x41555448, MSG_AUTH_RESPONSE = 0x41555452
+    MSG_AUTH_REQUEST  = 0x41555448, MSG_AUTH_RESPONSE = 0x41555452,
+    MSG_NET_REPORT    = 0x4E455452, MSG_NACK          = 0x4E41434B,
+    MSG_FRAME_LOSS    = 0x464C4F53, MSG_TRACE_REPORT  = 0x54524345,
+    MSG_CURSOR_POS    = 0x43504F53, MSG_CURSOR_SHAPE  = 0x43534850,
+    MSG_CURSOR_REQUEST = 0x43524551, MSG_PRESENT_REPORT = 0x50524553,
+    MSG_AUDIO_CONFIG  = 0x41434647, MSG_MOUSE_REL     = 0x4D52454C
 };
 
 inline int64_t GetTimestamp() {
@@ -75,6 +80,50 @@ void SafeRelease(T*&... p) {
     ((p ? (p->Release(), p = nullptr) : nullptr), ...);
 }
 
+// Single-producer, single-consumer handoff of preallocated slots, each Clear()ed before the producer reuses it
+template<typename T, uint32_t N>
+class SlotRing {
+    static_assert(N > 1 && (N & (N - 1)) == 0, "Ring size must be a power of two");
+
+private:
+    T frames[N];
+    alignas(64) std::atomic<uint32_t> head{0};
+    alignas(64) std::atomic<uint32_t> tail{0};
+    HANDLE event;
+
+public:
+    SlotRing() { event = CreateEventW(nullptr, FALSE, FALSE, nullptr); }
+    ~SlotRing() { CloseHandle(event); }
+    SlotRing(const SlotRing&) = delete;
+    SlotRing& operator=(const SlotRing&) = delete;
+
+    // Producer side: slot is owned by the producer until Commit(), nullptr while the consumer still holds every slot
+    T* Acquire() {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= N) return nullptr;
+        T* f = &frames[h & (N - 1)];
+        f->Clear();
+        return f;
+    }
+
+    void Commit() {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        SetEvent(event);
+    }
+
+    // Consumer side: the slot stays valid until Release() returns it to the producer
+    T* Peek(DWORD timeoutMs = 8) {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (head.load(std::memory_order_acquire) == t &&
+            (WaitForSingleObject(event, timeoutMs) != WAIT_OBJECT_0 || head.load(std::memory_order_acquire) == t))
+            return nullptr;
+        return &frames[t & (N - 1)];
+    }
+
+    void Release() { tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+    void Wake() { SetEvent(event); }
+};
+
 struct MTLock {
     ID3D11Multithread* mt;
     MTLock(ID3D11Multithread* m) : mt(m) { if (mt) mt->Enter(); }
@@ -0,0 +1,118 @@
+/**
+ * @file congestion.hpp
+ * @brief Delay and loss based bitrate controller for the video stream
+ * @copyright 2025-2026 Daniel Chrobak
+ */
+
+#pragma once
+#include "common.hpp"
+
+class CongestionController {
+public:
+    static constexpr int64_t MIN_BITRATE = 1000000, MAX_BITRATE = 40000000, START_BITRATE = 20000000;
+
+private:
+    static constexpr int64_t UPDATE_INTERVAL_US = 100000, MIN_RTT_WINDOW_US = 10000000;
+    // Chunk loss at which each FEC level starts, and the group size of levels 0 (off) to 3. A level is left for a sparser
+    // one only once loss falls FEC_RELAX below its threshold, so readings hovering at a threshold don't flap the group.
+    static constexpr double FEC_THRESHOLDS[] = {0.005, 0.02, 0.05}, FEC_RELAX = 0.6;
+    static constexpr int FEC_GROUPS[] = {0, 10, 5, 3};
+
+    enum class Usage { Under, Normal, Over };
+
+    const size_t bufferThreshold;
+    std::mutex mutex;
+    double bufferAvg = 0, bufferSlope = 0, lossAvg = 0, chunkLossAvg = 0;
+    int fecGroup = 0, fecLevel = 0;
+    size_t lastBuffered = 0;
+    int64_t lastSampleTs = 0, lastUpdateTs = 0, lastDecreaseTs = 0;
+    int64_t minRttUs = 0, minRttTs = 0, smoothedRttUs = 0;
+    int64_t targetBps = START_BITRATE, lastCongestedBps = 0;
+    std::atomic<int64_t> publishedBps{START_BITRATE};
+
+    Usage Detect() const {
+        bool queueGrowing = bufferAvg > bufferThreshold * 0.25 && bufferSlope > 0;
+        bool rttInflated = minRttUs > 0 && smoothedRttUs > minRttUs + std::max<int64_t>(10000, minRttUs / 2);
+        if (queueGrowing || rttInflated || lossAvg > 0.10) return Usage::Over;
+        if (bufferAvg < bufferThreshold * 0.05 && lossAvg < 0.02) return Usage::Under;
+        return Usage::Normal;
+    }
+
+    void Update(int64_t now) {
+        if (!lastUpdateTs) lastUpdateTs = now;
+        if (now - lastUpdateTs < UPDATE_INTERVAL_US) return;
+        double dt = std::min(1.0, (now - lastUpdateTs) / 1e6);
+        lastUpdateTs = now;
+
+        switch (Detect()) {
+            case Usage::Over:
+                // Back off at most once per round trip so a single queue spike is not punished repeatedly
+                if (now - lastDecreaseTs > smoothedRttUs + UPDATE_INTERVAL_US * 2) {
+                    lastCongestedBps = targetBps;
+                    targetBps = static_cast<int64_t>(targetBps * (lossAvg > 0.10 ? 1.0 - lossAvg * 0.5 : 0.85));
+                    lastDecreaseTs = now;
+                }
+                break;
+            case Usage::Under:
+                // Multiplicative ramp far from the last congestion point, additive probing close to it
+                targetBps += (lastCongestedBps && targetBps > lastCongestedBps * 0.9)
+                    ? static_cast<int64_t>(500000 * dt) : static_cast<int64_t>(targetBps * 0.25 * dt);
+                break;
+            case Usage::Normal: break;
+        }
+
+        targetBps = std::clamp(targetBps, MIN_BITRATE, MAX_BITRATE);
+        publishedBps = targetBps;
+    }
+
+    static int FecLevel(double loss, double scale) { int level = 0; for (double t : FEC_THRESHOLDS) level += loss >= t * scale; return level; }
+public:
+    explicit CongestionController(size_t threshold) : bufferThreshold(threshold) {}
+
+    void Reset() {
+        std::lock_guard<std::mutex> lock(mutex);
+        bufferAvg = bufferSlope = lossAvg = chunkLossAvg = 0; lastBuffered = 0; fecGroup = fecLevel = 0;
+        lastSampleTs = lastUpdateTs = lastDecreaseTs = minRttUs = minRttTs = smoothedRttUs = lastCongestedBps = 0;
+        targetBps = publishedBps = START_BITRATE;
+    }
+
+    void OnBufferedAmount(size_t bytes, int64_t nowUs) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (lastSampleTs && nowUs > lastSampleTs) {
+            double slope = (static_cast<double>(bytes) - static_cast<double>(lastBuffered)) * 1e6 / (nowUs - lastSampleTs);
+            bufferSlope = bufferSlope * 0.8 + slope * 0.2;
+        }
+        bufferAvg = bufferAvg * 0.8 + bytes * 0.2;
+        lastBuffered = bytes; lastSampleTs = nowUs;
+        Update(nowUs);
+    }
+
+    void OnRtt(int64_t rttUs, int64_t nowUs) {
+        if (rttUs <= 0 || rttUs > 5000000) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        smoothedRttUs = smoothedRttUs ? (smoothedRttUs * 7 + rttUs) / 8 : rttUs;
+        if (!minRttUs || rttUs < minRttUs || nowUs - minRttTs > MIN_RTT_WINDOW_US) { minRttUs = rttUs; minRttTs = nowUs; }
+    }
+
+    void OnLossReport(uint32_t received, uint32_t dropped) {
+        if (!received && !dropped) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        lossAvg = lossAvg * 0.5 + (static_cast<double>(dropped) / (received + dropped)) * 0.5;
+    }
+
+    // Chunk loss before FEC recovery; frame loss alone hides the losses FEC is already repairing
+    void OnChunkReport(uint32_t received, uint32_t lost) {
+        if (!received && !lost) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        chunkLossAvg = chunkLossAvg * 0.7 + (static_cast<double>(lost) / (received + lost)) * 0.3;
+        // One parity chunk per group handles one loss per group, so the group shrinks as loss grows; protection is
+        // added on the first report past a threshold but taken away only well below it
+        int denser = FecLevel(chunkLossAvg, 1.0), sparser = FecLevel(chunkLossAvg, FEC_RELAX);
+        if (denser > fecLevel) fecLevel = denser;
+        else if (sparser < fecLevel) fecLevel = sparser;
+        fecGroup = FEC_GROUPS[fecLevel];
+    }
+
+    int GetFecGroupSize() { std::lock_guard<std::mutex> lock(mutex); return fecGroup; }
+    int64_t GetTargetBitrate() const { return publishedBps; }
+};
@@ -0,0 +1,127 @@
+/**
+ * @file convert.hpp
+ * @brief GPU video processor conversion from captured RGB to NV12/P010 encoder surfaces
+ * @copyright 2025-2026 Daniel Chrobak
+ */
+
+#pragma once
+#include "common.hpp"
+#include <dxgi1_6.h>
+
+class VideoConverter {
+public:
+    static constexpr int MAX_SLOTS = 16;
+
+private:
+    static constexpr int INPUT_CACHE = 4;
+
+    struct InputView { ID3D11Texture2D* tex = nullptr; ID3D11VideoProcessorInputView* view = nullptr; };
+
+    ID3D11VideoDevice* videoDevice = nullptr;
+    ID3D11VideoContext1* videoContext = nullptr;
+    ID3D11VideoProcessorEnumerator* enumerator = nullptr;
+    ID3D11VideoProcessor* processor = nullptr;
+    ID3D11VideoProcessorOutputView* outputs[MAX_SLOTS] = {};
+    InputView inputs[INPUT_CACHE];
+    int slotCount = 0, nextInput = 0;
+
+    void ReleaseResources() {
+        for (auto& o : outputs) SafeRelease(o);
+        for (auto& i : inputs) SafeRelease(i.view, i.tex);
+        SafeRelease(processor, enumerator);
+        slotCount = nextInput = 0;
+    }
+
+    // WGC recycles a couple of surfaces per frame pool, so input views are cached by texture
+    ID3D11VideoProcessorInputView* GetInputView(ID3D11Texture2D* tex) {
+        for (auto& i : inputs) if (i.tex == tex) return i.view;
+        auto& slot = inputs[nextInput++ % INPUT_CACHE];
+        SafeRelease(slot.view, slot.tex);
+        D3D11_VIDEO_PROCESSOR_INPUT_VIEW_DESC vd = {0, D3D11_VPIV_DIMENSION_TEXTURE2D, {0, 0}};
+        if (FAILED(videoDevice->CreateVideoProcessorInputView(tex, enumerator, &vd, &slot.view))) return nullptr;
+        slot.tex = tex; tex->AddRef();
+        return slot.view;
+    }
+
+public:
+    ~VideoConverter() { ReleaseResources(); SafeRelease(videoContext, videoDevice); }
+
+    static bool IsHdrMonitor(ID3D11Device* device, HMONITOR monitor) {
+        winrt::com_ptr<IDXGIDevice> dxgi;
+        winrt::com_ptr<IDXGIAdapter> adapter;
+        if (FAILED(device->QueryInterface(IID_PPV_ARGS(dxgi.put()))) || FAILED(dxgi->GetAdapter(adapter.put()))) return false;
+
+        winrt::com_ptr<IDXGIOutput> output;
+        for (UINT i = 0; adapter->EnumOutputs(i, output.put()) != DXGI_ERROR_NOT_FOUND; i++, output = nullptr) {
+            DXGI_OUTPUT_DESC1 desc;
+            auto out6 = output.try_as<IDXGIOutput6>();
+            if (out6 && SUCCEEDED(out6->GetDesc1(&desc)) && desc.Monitor == monitor)
+                return desc.ColorSpace == DXGI_COLOR_SPACE_RGB_FULL_G2084_NONE_P2020;
+        }
+        return false;
+    }
+
+    // pool is the encoder surface array (NV12 or P010); hdr selects scRGB FP16 input with PQ/BT.2020 output.
+    // A pool smaller than the capture (outWidth/outHeight) gets a scaled copy from the same blit.
+    bool Init(ID3D11Device* device, ID3D11DeviceContext* context, ID3D11Texture2D* pool, int count, int width, int height, bool hdr,
+              int outWidth = 0, int outHeight = 0) {
+        ReleaseResources();
+        if (!outWidth || !outHeight) { outWidth = width; outHeight = height; }
+        if (count > MAX_SLOTS) return false;
+        if (!videoDevice && FAILED(device->QueryInterface(IID_PPV_ARGS(&videoDevice)))) return false;
+        if (!videoContext && FAILED(context->QueryInterface(IID_PPV_ARGS(&videoContext)))) return false;
+
+        D3D11_TEXTURE2D_DESC pd; pool->GetDesc(&pd);
+        DXGI_FORMAT inFmt = hdr ? DXGI_FORMAT_R16G16B16A16_FLOAT : DXGI_FORMAT_B8G8R8A8_UNORM;
+        DXGI_COLOR_SPACE_TYPE inCs = hdr ? DXGI_COLOR_SPACE_RGB_FULL_G10_NONE_P709 : DXGI_COLOR_SPACE_RGB_FULL_G22_NONE_P709;
+        DXGI_COLOR_SPACE_TYPE outCs = hdr ? DXGI_COLOR_SPACE_YCBCR_STUDIO_G2084_LEFT_P2020 : DXGI_COLOR_SPACE_YCBCR_STUDIO_G22_LEFT_P709;
+
+        D3D11_VIDEO_PROCESSOR_CONTENT_DESC cd = {D3D11_VIDEO_FRAME_FORMAT_PROGRESSIVE, {60, 1}, static_cast<UINT>(width), static_cast<UINT>(height),
+                                                 {60, 1}, static_cast<UINT>(outWidth), static_cast<UINT>(outHeight), D3D11_VIDEO_USAGE_OPTIMAL_SPEED};
+        if (FAILED(videoDevice->CreateVideoProcessorEnumerator(&cd, &enumerator))) { ReleaseResources(); return false; }
+
+        UINT inFlags = 0, outFlags = 0;
+        if (FAILED(enumerator->CheckVideoProcessorFormat(inFmt, &inFlags)) || !(inFlags & D3D11_VIDEO_PROCESSOR_FORMAT_SUPPORT_INPUT) ||
+            FAILED(enumerator->CheckVideoProcessorFormat(pd.Format, &outFlags)) || !(outFlags & D3D11_VIDEO_PROCESSOR_FORMAT_SUPPORT_OUTPUT)) {
+            ReleaseResources(); return false;
+        }
+        if (hdr) {
+            BOOL supported = FALSE;
+            ID3D11VideoProcessorEnumerator1* e1 = nullptr;
+            if (FAILED(enumerator->QueryInterface(IID_PPV_ARGS(&e1)))) { ReleaseResources(); return false; }
+            HRESULT hr = e1->CheckVideoProcessorFormatConversion(inFmt, inCs, pd.Format, outCs, &supported);
+            e1->Release();
+            if (FAILED(hr) || !supported) { ReleaseResources(); return false; }
+        }
+
+        if (FAILED(videoDevice->CreateVideoProcessor(enumerator, 0, &processor))) { ReleaseResources(); return false; }
+
+        RECT rect = {0, 0, width, height}, outRect = {0, 0, outWidth, outHeight};
+        videoContext->VideoProcessorSetStreamFrameFormat(processor, 0, D3D11_VIDEO_FRAME_FORMAT_PROGRESSIVE);
+        videoContext->VideoProcessorSetStreamAutoProcessingMode(processor, 0, FALSE);
+        videoContext->VideoProcessorSetStreamSourceRect(processor, 0, TRUE, &rect);
+        videoContext->VideoProcessorSetStreamDestRect(processor, 0, TRUE, &outRect);
+        videoContext->VideoProcessorSetOutputTargetRect(processor, TRUE, &outRect);
+        videoContext->VideoProcessorSetStreamColorSpace1(processor, 0, inCs);
+        videoContext->VideoProcessorSetOutputColorSpace1(processor, outCs);
+
+        D3D11_VIDEO_PROCESSOR_OUTPUT_VIEW_DESC od = {D3D11_VPOV_DIMENSION_TEXTURE2DARRAY};
+        for (int i = 0; i < count; i++) {
+            od.Texture2DArray = {0, static_cast<UINT>(i), 1};
+            if (FAILED(videoDevice->CreateVideoProcessorOutputView(pool, enumerator, &od, &outputs[i]))) { ReleaseResources(); return false; }
+        }
+
+        slotCount = count;
+        return true;
+    }
+
+    // Caller holds the device multithread lock; writes one converted frame into pool slice
+    bool Convert(ID3D11Texture2D* source, int slice) {
+        if (slice < 0 || slice >= slotCount) return false;
+        auto* view = GetInputView(source);
+        if (!view) return false;
+        D3D11_VIDEO_PROCESSOR_STREAM stream = {TRUE};
+        stream.pInputSurface = view;
+        return SUCCEEDED(videoContext->VideoProcessorBlt(processor, outputs[slice], 0, 1, &stream));
+    }
+};
@@ -0,0 +1,146 @@
+/**
+ * @file cursor.hpp
+ * @brief Polls the system cursor and publishes its position and shape apart from the video stream
+ * @copyright 2025-2026 Daniel Chrobak
+ */
+
+#pragma once
+#include "common.hpp"
+#include "trace.hpp"
+
+#pragma pack(push, 1)
+// Position is normalized to the captured monitor; shape is the hash of a CURSOR_SHAPE message (0 = none to draw)
+struct CursorPosMsg { uint32_t magic; float x, y; uint32_t shape; uint8_t visible; };
+// Followed by width * height RGBA pixels, top-down
+struct CursorShapeHeader { uint32_t magic, hash; uint16_t width, height, hotX, hotY; };
+#pragma pack(pop)
+
+class CursorTracker {
+public:
+    // A whole CURSOR_SHAPE message, shared by every session that sends it
+    using Shape = std::shared_ptr<const std::vector<uint8_t>>;
+    // shape is only set the first time a cursor is seen and should go out ahead of the position
+    using Callback = std::function<void(const CursorPosMsg&, const Shape&)>;
+
+private:
+    static constexpr int MAX_SIZE = 128;
+    static constexpr size_t MAX_SHAPES = 64;
+    static constexpr int64_t KEEPALIVE_US = 250000;
+
+    std::mutex mutex;
+    std::unordered_map<HCURSOR, uint32_t> handleHashes;
+    std::unordered_map<uint32_t, Shape> shapes;
+    std::atomic<int> monitorX{0}, monitorY{0}, monitorWidth{1}, monitorHeight{1}, intervalUs{1000000 / 60};
+    Callback onChange;
+    std::atomic<bool> running{false};
+    std::thread worker;
+
+    // Monochrome cursors are an AND mask over an XOR mask; pixels that invert the screen are drawn black
+    static Shape Rasterize(HCURSOR cursor) {
+        ICONINFO ii;
+        if (!GetIconInfo(cursor, &ii)) return nullptr;
+        BITMAP bm{};
+        GetObject(ii.hbmColor ? ii.hbmColor : ii.hbmMask, sizeof(bm), &bm);
+        int w = bm.bmWidth, h = ii.hbmColor ? bm.bmHeight : bm.bmHeight / 2;
+
+        auto read = [w](HBITMAP bmp, int rows, std::vector<uint32_t>& out) {
+            BITMAPINFO bi{};
+            bi.bmiHeader = {sizeof(BITMAPINFOHEADER), w, -rows, 1, 32, BI_RGB};
+            out.resize(static_cast<size_t>(w) * rows);
+            HDC dc = GetDC(nullptr);
+            bool ok = GetDIBits(dc, bmp, 0, rows, out.data(), &bi, DIB_RGB_COLORS) == rows;
+            ReleaseDC(nullptr, dc);
+            return ok;
+        };
+        std::vector<uint32_t> color, mask;
+        bool ok = w > 0 && h > 0 && w <= MAX_SIZE && h <= MAX_SIZE &&
+                  read(ii.hbmMask, ii.hbmColor ? h : h * 2, mask) && (!ii.hbmColor || read(ii.hbmColor, h, color));
+        if (ii.hbmColor) DeleteObject(ii.hbmColor);
+        if (ii.hbmMask) DeleteObject(ii.hbmMask);
+        if (!ok) return nullptr;
+
+        size_t n = static_cast<size_t>(w) * h;
+        auto msg = std::make_shared<std::vector<uint8_t>>(sizeof(CursorShapeHeader) + n * 4);
+        uint8_t* px = msg->data() + sizeof(CursorShapeHeader);
+        bool alpha = std::any_of(color.begin(), color.end(), [](uint32_t c) { return (c >> 24) != 0; });
+        for (size_t i = 0; i < n; i++, px += 4) {
+            uint32_t c, a;
+            if (!color.empty()) { c = color[i]; a = alpha ? c >> 24 : ((mask[i] & 0xFFFFFF) ? 0 : 255); }
+            else {
+                bool andBit = mask[i] & 0xFFFFFF, xorBit = mask[n + i] & 0xFFFFFF;
+                c = !andBit && xorBit ? 0xFFFFFF : 0; a = andBit && !xorBit ? 0 : 255;
+            }
+            px[0] = (c >> 16) & 0xFF; px[1] = (c >> 8) & 0xFF; px[2] = c & 0xFF; px[3] = static_cast<uint8_t>(a);
+        }
+
+        auto* hdr = reinterpret_cast<CursorShapeHeader*>(msg->data());
+        *hdr = {MSG_CURSOR_SHAPE, 0, static_cast<uint16_t>(w), static_cast<uint16_t>(h), static_cast<uint16_t>(ii.xHotspot), static_cast<uint16_t>(ii.yHotspot)};
+        uint32_t hash = 2166136261u;
+        for (size_t i = 8; i < msg->size(); i++) hash = (hash ^ (*msg)[i]) * 16777619u;
+        hdr->hash = hash ? hash : 1;
+        return msg;
+    }
+
+    void Run() {
+        Trace::NameThread("cursor");
+        HANDLE timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        if (!timer) timer = CreateWaitableTimerW(nullptr, FALSE, nullptr);
+        CursorPosMsg last{};
+        int64_t lastSent = 0;
+
+        while (running) {
+            CURSORINFO ci{sizeof(ci)};
+            if (GetCursorInfo(&ci)) {
+                bool visible = (ci.flags & CURSOR_SHOWING) && ci.hCursor;
+                uint32_t hash = 0;
+                Shape fresh;
+                if (visible) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    auto it = handleHashes.find(ci.hCursor);
+                    if (it != handleHashes.end()) hash = it->second;
+                    else {
+                        if (handleHashes.size() >= MAX_SHAPES) { handleHashes.clear(); shapes.clear(); }
+                        if ((fresh = Rasterize(ci.hCursor))) { hash = reinterpret_cast<const CursorShapeHeader*>(fresh->data())->hash; shapes[hash] = fresh; }
+                        handleHashes[ci.hCursor] = hash;
+                    }
+                }
+
+                CursorPosMsg pos = {MSG_CURSOR_POS, static_cast<float>(ci.ptScreenPos.x - monitorX) / monitorWidth,
+                                    static_cast<float>(ci.ptScreenPos.y - monitorY) / monitorHeight, hash, static_cast<uint8_t>(visible && hash)};
+                int64_t now = GetTimestamp();
+                // Repeated now and then: the channel is unreliable and a viewer may have joined since the last move
+                bool changed = pos.x != last.x || pos.y != last.y || pos.shape != last.shape || pos.visible != last.visible;
+                if ((changed || fresh || now - lastSent > KEEPALIVE_US) && onChange) { onChange(pos, fresh); last = pos; lastSent = now; }
+            }
+
+            LARGE_INTEGER due; due.QuadPart = -static_cast<int64_t>(intervalUs) * 10;
+            if (timer && SetWaitableTimer(timer, &due, 0, nullptr, nullptr, FALSE)) WaitForSingleObject(timer, 100);
+            else Sleep(1);
+        }
+        if (timer) CloseHandle(timer);
+    }
+
+public:
+    ~CursorTracker() { Stop(); }
+
+    void SetCallback(Callback cb) { onChange = std::move(cb); }
+
+    void UpdateFromMonitorInfo(const MonitorInfo& info) {
+        MONITORINFO mi{sizeof(mi)};
+        if (!GetMonitorInfo(info.hMon, &mi)) return;
+        monitorX = mi.rcMonitor.left; monitorY = mi.rcMonitor.top;
+        monitorWidth = std::max(1L, mi.rcMonitor.right - mi.rcMonitor.left); monitorHeight = std::max(1L, mi.rcMonitor.bottom - mi.rcMonitor.top);
+    }
+
+    // Polled at the capture rate so the cursor never lags the picture under it
+    void SetFPS(int fps) { if (fps > 0) intervalUs = 1000000 / fps; }
+
+    void Start() { if (!running.exchange(true)) worker = std::thread([this] { Run(); }); }
+    void Stop() { running = false; if (worker.joinable()) worker.join(); }
+
+    Shape GetShape(uint32_t hash) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = shapes.find(hash);
+        return it != shapes.end() ? it->second : nullptr;
+    }
+};
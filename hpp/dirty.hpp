@@ -0,0 +1,161 @@
+/**
+ * @file dirty.hpp
+ * @brief GPU tile comparison for static frame and dirty region detection
+ * @copyright 2025-2026 Daniel Chrobak
+ */
+
+#pragma once
+#include "common.hpp"
+#include <d3dcompiler.h>
+
+class DirtyTracker {
+public:
+    static constexpr int TILE_SIZE = 64, MAX_RECTS = 32, MAX_SLOTS = 16;
+
+private:
+    static constexpr const char* SHADER = R"(
+Texture2DArray<float> curY : register(t0);
+Texture2DArray<float> prevY : register(t1);
+Texture2DArray<float2> curUV : register(t2);
+Texture2DArray<float2> prevUV : register(t3);
+RWStructuredBuffer<uint> tiles : register(u0);
+groupshared uint changed;
+
+[numthreads(16, 16, 1)]
+void main(uint3 gid : SV_GroupID, uint3 tid : SV_GroupThreadID, uint gi : SV_GroupIndex) {
+    if (gi == 0) changed = 0;
+    GroupMemoryBarrierWithGroupSync();
+    uint w, h, n; curY.GetDimensions(w, h, n);
+    uint2 base = gid.xy * 64 + tid.xy * 4;
+    bool diff = false;
+    [unroll] for (uint y = 0; y < 4; y++)
+        [unroll] for (uint x = 0; x < 4; x++)
+            diff = diff || curY.Load(int4(base + uint2(x, y), 0, 0)) != prevY.Load(int4(base + uint2(x, y), 0, 0));
+    [unroll] for (uint cy = 0; cy < 2; cy++)
+        [unroll] for (uint cx = 0; cx < 2; cx++)
+            diff = diff || any(curUV.Load(int4(base / 2 + uint2(cx, cy), 0, 0)) != prevUV.Load(int4(base / 2 + uint2(cx, cy), 0, 0)));
+    if (diff) InterlockedOr(changed, 1);
+    GroupMemoryBarrierWithGroupSync();
+    if (gi == 0) tiles[gid.y * ((w + 63) / 64) + gid.x] = changed;
+}
+)";
+
+    ID3D11ComputeShader* shader = nullptr;
+    ID3D11Buffer* tileBuffer = nullptr;
+    ID3D11UnorderedAccessView* tileUav = nullptr;
+    ID3D11Buffer* staging[MAX_SLOTS] = {};
+    ID3D11ShaderResourceView* lumaViews[MAX_SLOTS] = {};
+    ID3D11ShaderResourceView* chromaViews[MAX_SLOTS] = {};
+    int tilesX = 0, tilesY = 0, slotCount = 0;
+    std::vector<uint32_t> mask;
+
+    void ReleaseResources() {
+        for (auto& s : staging) SafeRelease(s);
+        for (auto& v : lumaViews) SafeRelease(v);
+        for (auto& v : chromaViews) SafeRelease(v);
+        SafeRelease(tileUav, tileBuffer);
+        slotCount = 0;
+    }
+
+public:
+    ~DirtyTracker() { ReleaseResources(); SafeRelease(shader); }
+
+    // Luma and chroma plane views per slice of the NV12/P010 pool array, so slot indices match FrameData::poolIdx
+    bool Init(ID3D11Device* device, ID3D11Texture2D* pool, int count, int width, int height) {
+        ReleaseResources();
+        if (count > MAX_SLOTS) return false;
+
+        if (!shader) {
+            ID3DBlob* blob = nullptr; ID3DBlob* errors = nullptr;
+            HRESULT hr = D3DCompile(SHADER, strlen(SHADER), "dirty", nullptr, nullptr, "main", "cs_5_0",
+                                    D3DCOMPILE_OPTIMIZATION_LEVEL3, 0, &blob, &errors);
+            if (errors) { if (FAILED(hr)) WARN("Dirty shader: %s", static_cast<const char*>(errors->GetBufferPointer())); errors->Release(); }
+            if (FAILED(hr)) return false;
+            hr = device->CreateComputeShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &shader);
+            blob->Release();
+            if (FAILED(hr)) return false;
+        }
+
+        tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+        tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+        UINT tileBytes = static_cast<UINT>(tilesX * tilesY * sizeof(uint32_t));
+        mask.resize(tilesX * tilesY);
+
+        D3D11_BUFFER_DESC bd = {tileBytes, D3D11_USAGE_DEFAULT, D3D11_BIND_UNORDERED_ACCESS, 0,
+                                D3D11_RESOURCE_MISC_BUFFER_STRUCTURED, sizeof(uint32_t)};
+        if (FAILED(device->CreateBuffer(&bd, nullptr, &tileBuffer)) ||
+            FAILED(device->CreateUnorderedAccessView(tileBuffer, nullptr, &tileUav))) { ReleaseResources(); return false; }
+
+        D3D11_BUFFER_DESC sd = {tileBytes, D3D11_USAGE_STAGING, 0, D3D11_CPU_ACCESS_READ, 0, 0};
+        D3D11_TEXTURE2D_DESC pd; pool->GetDesc(&pd);
+        bool wide = pd.Format == DXGI_FORMAT_P010;
+        D3D11_SHADER_RESOURCE_VIEW_DESC yd = {}, cd = {};
+        yd.ViewDimension = cd.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+        yd.Format = wide ? DXGI_FORMAT_R16_UNORM : DXGI_FORMAT_R8_UNORM;
+        cd.Format = wide ? DXGI_FORMAT_R16G16_UNORM : DXGI_FORMAT_R8G8_UNORM;
+        yd.Texture2DArray = cd.Texture2DArray = {0, 1, 0, 1};
+        for (int i = 0; i < count; i++) {
+            yd.Texture2DArray.FirstArraySlice = cd.Texture2DArray.FirstArraySlice = i;
+            if (FAILED(device->CreateBuffer(&sd, nullptr, &staging[i])) ||
+                FAILED(device->CreateShaderResourceView(pool, &yd, &lumaViews[i])) ||
+                FAILED(device->CreateShaderResourceView(pool, &cd, &chromaViews[i]))) { ReleaseResources(); return false; }
+        }
+
+        slotCount = count;
+        return true;
+    }
+
+    // Must run on the capture context right after the copy into slot cur so the frame fence covers the readback copy
+    bool Dispatch(ID3D11DeviceContext* ctx, int cur, int prev) {
+        if (!slotCount || cur < 0 || prev < 0 || cur >= slotCount || prev >= slotCount || cur == prev) return false;
+        ID3D11ShaderResourceView* srvs[4] = {lumaViews[cur], lumaViews[prev], chromaViews[cur], chromaViews[prev]};
+        ID3D11ShaderResourceView* nullSrvs[4] = {};
+        ID3D11UnorderedAccessView* nullUav = nullptr;
+
+        ctx->CSSetShader(shader, nullptr, 0);
+        ctx->CSSetShaderResources(0, 4, srvs);
+        ctx->CSSetUnorderedAccessViews(0, 1, &tileUav, nullptr);
+        ctx->Dispatch(tilesX, tilesY, 1);
+        ctx->CSSetShaderResources(0, 4, nullSrvs);
+        ctx->CSSetUnorderedAccessViews(0, 1, &nullUav, nullptr);
+        ctx->CSSetShader(nullptr, nullptr, 0);
+        ctx->CopyResource(staging[cur], tileBuffer);
+        return true;
+    }
+
+    // Returns the number of changed tiles (-1 if unknown) and fills rects with merged dirty areas in pixels
+    int Read(ID3D11DeviceContext* ctx, int slot, int width, int height, std::vector<RECT>& rects) {
+        rects.clear();
+        if (slot < 0 || slot >= slotCount) return -1;
+
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        if (FAILED(ctx->Map(staging[slot], 0, D3D11_MAP_READ, 0, &mapped))) return -1;
+        memcpy(mask.data(), mapped.pData, mask.size() * sizeof(uint32_t));
+        ctx->Unmap(staging[slot], 0);
+
+        int dirty = 0;
+        RECT bounds = {LONG_MAX, LONG_MAX, 0, 0};
+        for (int ty = 0; ty < tilesY; ty++) {
+            for (int tx = 0; tx < tilesX; tx++) {
+                if (!mask[ty * tilesX + tx]) continue;
+                int start = tx;
+                while (tx + 1 < tilesX && mask[ty * tilesX + tx + 1]) tx++;
+                dirty += tx - start + 1;
+
+                RECT r = {start * TILE_SIZE, ty * TILE_SIZE, std::min((tx + 1) * TILE_SIZE, width), std::min((ty + 1) * TILE_SIZE, height)};
+                bounds = {std::min(bounds.left, r.left), std::min(bounds.top, r.top), std::max(bounds.right, r.right), std::max(bounds.bottom, r.bottom)};
+
+                auto above = std::find_if(rects.begin(), rects.end(), [&](const RECT& a) {
+                    return a.left == r.left && a.right == r.right && a.bottom == r.top;
+                });
+                if (above != rects.end()) above->bottom = r.bottom;
+                else rects.push_back(r);
+            }
+        }
+
+        if (rects.size() > MAX_RECTS) rects.assign(1, bounds);
+        return dirty;
+    }
+
+    int GetTileCount() const { return tilesX * tilesY; }
+};
@@ -6,15 +6,32 @@
 
 #pragma once
 #include "common.hpp"
+#include "gpusync.hpp"
+#include "planes.hpp"
 
 struct EncodedFrame {
     std::vector<uint8_t> data;
     int64_t ts = 0, encUs = 0;
     bool isKey = false;
-    void Clear() { data.clear(); ts = encUs = 0; isKey = false; }
+    int layer = 0;       // 0 = full resolution, 1 = half-size simulcast rung
+    uint8_t stream = 0;  // Index of the monitor the frame was captured from
+    void Clear() { data.clear(); ts = encUs = 0; isKey = false; layer = 0; stream = 0; }
+};
+
+template<uint32_t N>
+using EncodedFrameRing = SlotRing<EncodedFrame, N>;
+
+struct EncoderSettings {
+    int keyframeIntervalMs = 2000;  // 0 disables periodic keyframes; loss reports and key requests still force them
+    int intraRefreshFrames = 0;     // >0 spreads a rolling intra refresh over this many frames where the encoder supports it
+    std::string codec;              // FFmpeg encoder name to require; empty takes the first available in preference order
 };
 
 class AV1Encoder {
+public:
+    // Preference order: hardware first, then software
+    static constexpr const char* CODECS[] = {"av1_nvenc", "av1_qsv", "av1_amf", "libsvtav1", "libaom-av1"};
+
 private:
     AVCodecContext* codecContext = nullptr;
     AVFrame* hwFrame = nullptr;
@@ -25,25 +42,37 @@ private:
     ID3D11Device* device = nullptr;
     ID3D11DeviceContext* context = nullptr;
     ID3D11Multithread* multithread = nullptr;
-    ID3D11Texture2D* stagingTexture = nullptr;
-    ID3D11Query* encodeQuery = nullptr;
+    GPUSync* gpuSync = nullptr;
+    ID3D11Texture2D* poolTexture = nullptr;
 
-    int width, height, frameNumber = 0;
+    int width, height, poolSize, frameNumber = 0;
     UINT stagingWidth = 0, stagingHeight = 0;
-    bool useHardware = false;
+    bool useHardware = false, tenBit = false, intraRefresh = false, roiHints = false;
+    EncoderSettings settings;
+    milliseconds keyframeInterval;
     steady_clock::time_point lastKeyframe;
-    static constexpr auto KEYFRAME_INTERVAL = 2000ms;
-
-    EncodedFrame outputFrames[2];
-    int outputIndex = 0;
-    std::atomic<uint64_t> encodedCount{0}, failedCount{0};
+    static constexpr int STAGING_DEPTH = 3;
+
+    struct Staged {
+        ID3D11Texture2D* tex = nullptr;
+        uint64_t fence = 0;
+        int64_t ts = 0, submitted = 0;
+        bool key = false;
+        std::vector<RECT> rois;
+    };
+    Staged staged[STAGING_DEPTH];
+    uint32_t stageHead = 0, stageTail = 0;
+
+    std::atomic<uint64_t> encodedCount{0}, failedCount{0}, readbackUs{0}, readbackCount{0}, readbackStalls{0};
+    std::vector<RECT> roiRects;
+    std::unique_ptr<RowWorkers> rowWorkers;
 
     static inline const int64_t queryFrequency = [] {
         LARGE_INTEGER f; QueryPerformanceFrequency(&f); return f.QuadPart;
     }();
 
     bool InitHardwareContext(const AVCodec* codec) {
-        if (strcmp(codec->name, "av1_nvenc") && strcmp(codec->name, "av1_qsv")) return false;
+        if (strcmp(codec->name, "av1_nvenc") && strcmp(codec->name, "av1_qsv") && strcmp(codec->name, "av1_amf")) return false;
 
         hwDevice = av_hwdevice_ctx_alloc(AV_HWDEVICE_TYPE_D3D11VA);
         if (!hwDevice) return false;
@@ -59,9 +88,15 @@ private:
         hwFrameCtx = av_hwframe_ctx_alloc(hwDevice);
         if (!hwFrameCtx) { av_buffer_unref(&hwDevice); return false; }
 
+        // Adopt the capture pool array as the frames context texture so capture writes straight into encoder surfaces
         auto* fc = reinterpret_cast<AVHWFramesContext*>(hwFrameCtx->data);
-        fc->format = AV_PIX_FMT_D3D11; fc->sw_format = AV_PIX_FMT_BGRA;
-        fc->width = width; fc->height = height; fc->initial_pool_size = 4;
+        fc->format = AV_PIX_FMT_D3D11; fc->sw_format = tenBit ? AV_PIX_FMT_P010 : AV_PIX_FMT_NV12;
+        fc->width = width; fc->height = height; fc->initial_pool_size = poolSize;
+
+        D3D11_TEXTURE2D_DESC td; poolTexture->GetDesc(&td);
+        auto* fh = reinterpret_cast<AVD3D11VAFramesContext*>(fc->hwctx);
+        poolTexture->AddRef();
+        fh->texture = poolTexture; fh->BindFlags = td.BindFlags; fh->MiscFlags = td.MiscFlags;
 
         if (av_hwframe_ctx_init(hwFrameCtx) < 0) { av_buffer_unref(&hwFrameCtx); av_buffer_unref(&hwDevice); return false; }
 
@@ -70,22 +105,14 @@ private:
         return true;
     }
 
-    bool WaitForGPU(DWORD timeoutMs = 16) {
-        if (!encodeQuery) return true;
-        context->End(encodeQuery);
-        LARGE_INTEGER start, now, freq;
-        QueryPerformanceCounter(&start); QueryPerformanceFrequency(&freq);
-        int64_t timeout = (freq.QuadPart * timeoutMs) / 1000;
-        while (context->GetData(encodeQuery, nullptr, 0, 0) == S_FALSE) {
-            QueryPerformanceCounter(&now);
-            if ((now.QuadPart - start.QuadPart) > timeout) return false;
-            YieldProcessor();
-        }
-        return true;
+    static void ReleaseSurface(void* opaque, uint8_t*) {
+        auto* release = static_cast<std::function<void()>*>(opaque);
+        if (*release) (*release)();
+        delete release;
     }
 
     void ConfigureEncoder(const AVCodec* codec) {
-        auto set = [this](const char* k, const char* v) { av_opt_set(codecContext->priv_data, k, v, 0); };
+        auto set = [this](const char* k, const char* v) { return av_opt_set(codecContext->priv_data, k, v, 0); };
         const char* name = codec->name;
 
         if (!strcmp(name, "av1_nvenc")) {
@@ -117,24 +144,123 @@ private:
                 {"enable-global-motion", "0"}, {"deltaq-mode", "0"}, {"enable-ref-frame-mvs", "0"},
                 {"reduced-reference-set", "1"}}) set(k, v);
         }
+
+        // FFmpeg has no reference invalidation for AV1, so loss recovery without IDR relies on a refresh wave
+        if (settings.intraRefreshFrames > 0) {
+            std::string cycle = std::to_string(settings.intraRefreshFrames);
+            if (!strcmp(name, "av1_nvenc")) intraRefresh = set("intra-refresh", "1") >= 0;
+            else if (!strcmp(name, "av1_qsv")) intraRefresh = set("int_ref_type", "vertical") >= 0 && set("int_ref_cycle_size", cycle.c_str()) >= 0;
+            if (intraRefresh) LOG("Intra refresh: %d frames", settings.intraRefreshFrames);
+            else WARN("Intra refresh unsupported by %s, recovering with keyframes", name);
+        }
+    }
+
+    bool EnsureStaging(ID3D11Texture2D* texture) {
+        D3D11_TEXTURE2D_DESC td; texture->GetDesc(&td);
+        if (staged[0].tex && stagingWidth == td.Width && stagingHeight == td.Height) return true;
+        for (auto& s : staged) SafeRelease(s.tex);
+        stageHead = stageTail = 0;
+        td.ArraySize = 1; td.Usage = D3D11_USAGE_STAGING; td.BindFlags = 0; td.CPUAccessFlags = D3D11_CPU_ACCESS_READ; td.MiscFlags = 0;
+        for (auto& s : staged)
+            if (FAILED(device->CreateTexture2D(&td, nullptr, &s.tex))) { for (auto& r : staged) SafeRelease(r.tex); return false; }
+        stagingWidth = td.Width; stagingHeight = td.Height;
+        return true;
+    }
+
+    // Maps the oldest staged copy, normally finished a frame ago so DO_NOT_WAIT succeeds without stalling. encUs runs
+    // from here: the time the frame sat staged is the overlap, not encode work, and readbackUs accounts for it.
+    bool EncodeStaged(EncodedFrame& output) {
+        LARGE_INTEGER start; QueryPerformanceCounter(&start);
+        Staged& s = staged[stageTail++ % STAGING_DEPTH];
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        HRESULT hr;
+        { MTLock lock(multithread); hr = context->Map(s.tex, 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped); }
+        if (hr == DXGI_ERROR_WAS_STILL_DRAWING) {
+            readbackStalls++;
+            if (gpuSync && !gpuSync->Wait(s.fence, context, 16)) { failedCount++; return false; }
+            MTLock lock(multithread); hr = context->Map(s.tex, 0, D3D11_MAP_READ, 0, &mapped);
+        }
+        if (FAILED(hr)) { failedCount++; return false; }
+
+        LARGE_INTEGER now; QueryPerformanceCounter(&now);
+        readbackUs += static_cast<uint64_t>((now.QuadPart - s.submitted) * 1000000 / queryFrequency);
+        readbackCount++;
+
+        if (av_frame_make_writable(hwFrame) < 0) { MTLock lock(multithread); context->Unmap(s.tex, 0); failedCount++; return false; }
+        auto* src = static_cast<const uint8_t*>(mapped.pData);
+        rowWorkers->Run(height / 2, [&](int begin, int end) { PlaneCopy::Convert(src, mapped.RowPitch, stagingHeight, hwFrame, width, tenBit, begin, end); });
+        { MTLock lock(multithread); context->Unmap(s.tex, 0); }
+        return Submit(s.key, s.rois, s.ts, start.QuadPart, output);
+    }
+
+    bool Submit(bool needsKeyframe, const std::vector<RECT>& rois, int64_t timestamp, int64_t startQpc, EncodedFrame& output) {
+        hwFrame->pts = frameNumber++;
+        hwFrame->pict_type = needsKeyframe ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+        hwFrame->flags = needsKeyframe ? (hwFrame->flags | AV_FRAME_FLAG_KEY) : (hwFrame->flags & ~AV_FRAME_FLAG_KEY);
+
+        av_frame_remove_side_data(hwFrame, AV_FRAME_DATA_REGIONS_OF_INTEREST);
+        if (roiHints && !needsKeyframe && !rois.empty()) {
+            if (auto* sd = av_frame_new_side_data(hwFrame, AV_FRAME_DATA_REGIONS_OF_INTEREST, rois.size() * sizeof(AVRegionOfInterest))) {
+                auto* roi = reinterpret_cast<AVRegionOfInterest*>(sd->data);
+                for (const auto& r : rois)
+                    *roi++ = {sizeof(AVRegionOfInterest), static_cast<int>(r.top), static_cast<int>(r.bottom),
+                              static_cast<int>(r.left), static_cast<int>(r.right), av_make_q(-1, 10)};
+            }
+        }
+
+        // Room for a keyframe-sized burst up front so the packet appends below don't regrow the ring slot
+        if (codecContext->framerate.num > 0)
+            output.data.reserve(static_cast<size_t>(codecContext->bit_rate / 8 * codecContext->framerate.den / codecContext->framerate.num * 4));
+
+        int ret = avcodec_send_frame(codecContext, hwFrame);
+        if (ret == AVERROR(EAGAIN)) {
+            while (avcodec_receive_packet(codecContext, packet) == 0) {
+                output.data.insert(output.data.end(), packet->data, packet->data + packet->size);
+                av_packet_unref(packet);
+            }
+            ret = avcodec_send_frame(codecContext, hwFrame);
+        }
+
+        if (ret < 0 && ret != AVERROR_EOF) { failedCount++; if (useHardware) av_frame_unref(hwFrame); return false; }
+
+        bool gotKeyframe = false;
+        while (avcodec_receive_packet(codecContext, packet) == 0) {
+            if (packet->flags & AV_PKT_FLAG_KEY) gotKeyframe = true;
+            output.data.insert(output.data.end(), packet->data, packet->data + packet->size);
+            av_packet_unref(packet);
+        }
+
+        if (useHardware) av_frame_unref(hwFrame);
+        if (output.data.empty()) return false;
+
+        LARGE_INTEGER endTime; QueryPerformanceCounter(&endTime);
+        output.ts = timestamp;
+        output.encUs = ((endTime.QuadPart - startQpc) * 1000000) / queryFrequency;
+        output.isKey = gotKeyframe;
+        encodedCount++;
+        return true;
     }
 
 public:
-    AV1Encoder(int w, int h, int fps, ID3D11Device* dev, ID3D11DeviceContext* ctx, ID3D11Multithread* mt)
-        : width(w), height(h), device(dev), context(ctx), multithread(mt) {
+    AV1Encoder(int w, int h, int fps, ID3D11Device* dev, ID3D11DeviceContext* ctx, ID3D11Multithread* mt, GPUSync* sync,
+               ID3D11Texture2D* pool, int poolCount, int64_t bitrate = 20000000, const EncoderSettings& cfg = {})
+        : device(dev), context(ctx), multithread(mt), gpuSync(sync), poolTexture(pool), width(w), height(h), poolSize(poolCount), settings(cfg) {
 
         device->AddRef();
         if (context) context->AddRef();
         else device->GetImmediateContext(&context);
         if (multithread) multithread->AddRef();
+        if (!poolTexture) throw std::runtime_error("No capture texture pool");
+        poolTexture->AddRef();
+        D3D11_TEXTURE2D_DESC pd; poolTexture->GetDesc(&pd);
+        tenBit = pd.Format == DXGI_FORMAT_P010;
 
-        lastKeyframe = steady_clock::now() - KEYFRAME_INTERVAL;
-        D3D11_QUERY_DESC qd = {D3D11_QUERY_EVENT, 0};
-        device->CreateQuery(&qd, &encodeQuery);
+        keyframeInterval = milliseconds(std::max(0, settings.keyframeIntervalMs));
+        lastKeyframe = steady_clock::now() - keyframeInterval;
 
         const AVCodec* codec = nullptr;
-        for (auto name : {"av1_nvenc", "av1_qsv", "av1_amf", "libsvtav1", "libaom-av1"})
-            if ((codec = avcodec_find_encoder_by_name(name))) { LOG("Encoder: %s", name); break; }
+        for (auto name : CODECS)
+            if ((settings.codec.empty() || settings.codec == name) && (codec = avcodec_find_encoder_by_name(name))) { LOG("Encoder: %s", name); break; }
 
         if (!codec) throw std::runtime_error("No AV1 encoder available");
 
@@ -142,17 +268,27 @@ public:
         if (!codecContext) throw std::runtime_error("Failed to allocate codec context");
 
         useHardware = strcmp(codec->name, "libaom-av1") && strcmp(codec->name, "libsvtav1") && InitHardwareContext(codec);
-        if (!useHardware) codecContext->pix_fmt = AV_PIX_FMT_BGRA;
+        // Of the CODECS wrappers only qsvenc reads ROI side data (as mfxExtEncoderROI, if the runtime supports it for AV1)
+        roiHints = !strcmp(codec->name, "av1_qsv");
+        if (!useHardware) codecContext->pix_fmt = tenBit ? AV_PIX_FMT_YUV420P10 : AV_PIX_FMT_YUV420P;
+        codecContext->color_range = AVCOL_RANGE_MPEG;
+        codecContext->color_primaries = tenBit ? AVCOL_PRI_BT2020 : AVCOL_PRI_BT709;
+        codecContext->color_trc = tenBit ? AVCOL_TRC_SMPTE2084 : AVCOL_TRC_BT709;
+        codecContext->colorspace = tenBit ? AVCOL_SPC_BT2020_NCL : AVCOL_SPC_BT709;
 
         codecContext->width = width; codecContext->height = height;
         codecContext->time_base = {1, fps}; codecContext->framerate = {fps, 1};
-        codecContext->bit_rate = 20000000; codecContext->rc_max_rate = 40000000; codecContext->rc_buffer_size = 40000000;
-        codecContext->gop_size = fps * 2; codecContext->max_b_frames = 0;
+        codecContext->bit_rate = bitrate; codecContext->rc_max_rate = bitrate * 2; codecContext->rc_buffer_size = static_cast<int>(bitrate * 2);
+        codecContext->max_b_frames = 0;
         codecContext->flags |= AV_CODEC_FLAG_LOW_DELAY; codecContext->flags2 |= AV_CODEC_FLAG2_FAST;
         codecContext->delay = 0; codecContext->has_b_frames = 0;
         codecContext->thread_count = useHardware ? 1 : std::min(4, std::max(1, static_cast<int>(std::thread::hardware_concurrency()) / 2));
 
         ConfigureEncoder(codec);
+        // Without periodic keyframes the GOP is left open; nvenc treats a negative size as infinite
+        codecContext->gop_size = intraRefresh ? settings.intraRefreshFrames
+            : keyframeInterval.count() > 0 ? std::max(1, static_cast<int>(fps * keyframeInterval.count() / 1000))
+            : !strcmp(codec->name, "av1_nvenc") ? -1 : fps * 600;
         if (avcodec_open2(codecContext, codec, nullptr) < 0) throw std::runtime_error("Failed to open encoder");
 
         hwFrame = av_frame_alloc(); packet = av_packet_alloc();
@@ -160,95 +296,95 @@ public:
 
         hwFrame->format = codecContext->pix_fmt; hwFrame->width = width; hwFrame->height = height;
         if (!useHardware && av_frame_get_buffer(hwFrame, 32) < 0) throw std::runtime_error("Failed to allocate frame buffer");
+        if (!useHardware) {
+            rowWorkers = std::make_unique<RowWorkers>(std::min(3, static_cast<int>(std::thread::hardware_concurrency()) / 4));
+            LOG("Readback: %s, %d helper threads", PlaneCopy::GetIsaName(), rowWorkers->GetCount());
+        }
 
-        LOG("Encoder mode: %s", useHardware ? "Hardware" : "Software");
+        LOG("Encoder mode: %s %d-bit", useHardware ? "Hardware" : "Software", tenBit ? 10 : 8);
     }
 
     ~AV1Encoder() {
         av_packet_free(&packet); av_frame_free(&hwFrame);
         av_buffer_unref(&hwFrameCtx); av_buffer_unref(&hwDevice);
         if (codecContext) avcodec_free_context(&codecContext);
-        SafeRelease(encodeQuery, stagingTexture, multithread, context, device);
+        for (auto& s : staged) SafeRelease(s.tex);
+        SafeRelease(poolTexture, multithread, context, device);
     }
 
     void Flush() {
         avcodec_send_frame(codecContext, nullptr);
         while (avcodec_receive_packet(codecContext, packet) == 0) av_packet_unref(packet);
         avcodec_flush_buffers(codecContext);
-        lastKeyframe = steady_clock::now() - KEYFRAME_INTERVAL;
+        stageTail = stageHead;
+        lastKeyframe = steady_clock::now() - keyframeInterval;
     }
 
-    EncodedFrame* Encode(ID3D11Texture2D* texture, int64_t timestamp, bool forceKeyframe = false) {
-        LARGE_INTEGER startTime, endTime;
+    // slice indexes the capture pool array; onRelease runs exactly once, when the encoder no longer reads that slice.
+    // The software path returns the previous frame while this one's readback is in flight (see HasPending).
+    bool Encode(ID3D11Texture2D* texture, int slice, int64_t timestamp, bool forceKeyframe, EncodedFrame& output,
+                std::function<void()> onRelease) {
+        LARGE_INTEGER startTime;
         QueryPerformanceCounter(&startTime);
 
-        EncodedFrame* output = &outputFrames[outputIndex++ % 2];
-        output->Clear();
-
-        bool needsKeyframe = forceKeyframe || (steady_clock::now() - lastKeyframe >= KEYFRAME_INTERVAL);
-
-        if (useHardware) {
-            if (av_hwframe_get_buffer(codecContext->hw_frames_ctx, hwFrame, 0) < 0) { failedCount++; return nullptr; }
-            MTLock lock(multithread);
-            context->CopySubresourceRegion(reinterpret_cast<ID3D11Texture2D*>(hwFrame->data[0]),
-                static_cast<UINT>(reinterpret_cast<intptr_t>(hwFrame->data[1])), 0, 0, 0, texture, 0, nullptr);
-            if (!WaitForGPU(16)) { failedCount++; av_frame_unref(hwFrame); return nullptr; }
-        } else {
-            D3D11_TEXTURE2D_DESC td; texture->GetDesc(&td);
-            if (!stagingTexture || stagingWidth != td.Width || stagingHeight != td.Height) {
-                SafeRelease(stagingTexture);
-                td.Usage = D3D11_USAGE_STAGING; td.BindFlags = 0; td.CPUAccessFlags = D3D11_CPU_ACCESS_READ; td.MiscFlags = 0;
-                device->CreateTexture2D(&td, nullptr, &stagingTexture);
-                stagingWidth = td.Width; stagingHeight = td.Height;
-            }
-            { MTLock lock(multithread); context->CopyResource(stagingTexture, texture); context->Flush(); }
-
-            D3D11_MAPPED_SUBRESOURCE mapped;
-            { MTLock lock(multithread); if (FAILED(context->Map(stagingTexture, 0, D3D11_MAP_READ, 0, &mapped))) { failedCount++; return nullptr; } }
-            if (av_frame_make_writable(hwFrame) < 0) { MTLock lock(multithread); context->Unmap(stagingTexture, 0); failedCount++; return nullptr; }
-
-            auto* src = static_cast<uint8_t*>(mapped.pData);
-            for (int y = 0; y < height; y++)
-                memcpy(hwFrame->data[0] + y * hwFrame->linesize[0], src + y * mapped.RowPitch, width * 4);
-            MTLock lock(multithread); context->Unmap(stagingTexture, 0);
-        }
-
-        hwFrame->pts = frameNumber++;
-        hwFrame->pict_type = needsKeyframe ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
-        hwFrame->flags = needsKeyframe ? (hwFrame->flags | AV_FRAME_FLAG_KEY) : (hwFrame->flags & ~AV_FRAME_FLAG_KEY);
+        bool needsKeyframe = forceKeyframe || (keyframeInterval.count() > 0 && steady_clock::now() - lastKeyframe >= keyframeInterval);
         if (needsKeyframe) lastKeyframe = steady_clock::now();
 
-        int ret = avcodec_send_frame(codecContext, hwFrame);
-        if (ret == AVERROR(EAGAIN)) {
-            while (avcodec_receive_packet(codecContext, packet) == 0) {
-                output->data.insert(output->data.end(), packet->data, packet->data + packet->size);
-                av_packet_unref(packet);
+        if (!useHardware) {
+            if (!EnsureStaging(texture)) { if (onRelease) onRelease(); failedCount++; return false; }
+            Staged& s = staged[stageHead % STAGING_DEPTH];
+            {
+                MTLock lock(multithread);
+                context->CopySubresourceRegion(s.tex, 0, 0, 0, 0, texture, D3D11CalcSubresource(0, slice, 1), nullptr);
+                s.fence = gpuSync ? gpuSync->Signal(context) : 0;
+                context->Flush();
             }
-            ret = avcodec_send_frame(codecContext, hwFrame);
+            // Later capture writes to the slice are queued behind this copy, so the slot can be reused right away
+            if (onRelease) onRelease();
+            s.ts = timestamp; s.key = needsKeyframe; s.rois = roiRects; s.submitted = startTime.QuadPart;
+            stageHead++;
+            return stageHead - stageTail > 1 ? EncodeStaged(output) : false;
         }
 
-        if (ret < 0 && ret != AVERROR_EOF) { failedCount++; if (useHardware) av_frame_unref(hwFrame); return nullptr; }
-
-        bool gotKeyframe = false;
-        while (avcodec_receive_packet(codecContext, packet) == 0) {
-            if (packet->flags & AV_PKT_FLAG_KEY) gotKeyframe = true;
-            output->data.insert(output->data.end(), packet->data, packet->data + packet->size);
-            av_packet_unref(packet);
-        }
+        if (texture != poolTexture) { if (onRelease) onRelease(); failedCount++; return false; }
+        // The frame references the pool slice directly; the encoder drops its ref once the surface is consumed
+        auto* release = new std::function<void()>(std::move(onRelease));
+        hwFrame->buf[0] = av_buffer_create(nullptr, 0, ReleaseSurface, release, AV_BUFFER_FLAG_READONLY);
+        if (!hwFrame->buf[0]) { ReleaseSurface(release, nullptr); failedCount++; return false; }
+        hwFrame->hw_frames_ctx = av_buffer_ref(hwFrameCtx);
+        if (!hwFrame->hw_frames_ctx) { av_frame_unref(hwFrame); failedCount++; return false; }
+        hwFrame->format = AV_PIX_FMT_D3D11; hwFrame->width = width; hwFrame->height = height;
+        hwFrame->data[0] = reinterpret_cast<uint8_t*>(texture);
+        hwFrame->data[1] = reinterpret_cast<uint8_t*>(static_cast<intptr_t>(slice));
+        return Submit(needsKeyframe, roiRects, timestamp, startTime.QuadPart, output);
+    }
 
-        if (useHardware) av_frame_unref(hwFrame);
-        if (output->data.empty()) return nullptr;
+    // Encodes a software frame still held in the staging ring; called when no newer frame arrived to push it out
+    bool EncodePending(EncodedFrame& output) { return HasPending() && EncodeStaged(output); }
+    bool HasPending() const { return stageHead != stageTail; }
 
-        QueryPerformanceCounter(&endTime);
-        output->ts = timestamp;
-        output->encUs = ((endTime.QuadPart - startTime.QuadPart) * 1000000) / queryFrequency;
-        output->isKey = gotKeyframe;
-        encodedCount++;
-        return output;
+    // nvenc and qsv pick up rate control changes on the next frame without reopening; other encoders keep their initial rate
+    void SetBitrate(int64_t bps) {
+        if (std::abs(bps - codecContext->bit_rate) * 20 < codecContext->bit_rate) return;
+        codecContext->bit_rate = bps; codecContext->rc_max_rate = bps * 2; codecContext->rc_buffer_size = static_cast<int>(bps * 2);
     }
 
-    uint64_t GetEncoded() { return encodedCount.exchange(0); }
-    uint64_t GetFailed() { return failedCount.exchange(0); }
+    // Dirty rectangles from the capture diff, attached as ROI side data for av1_qsv only. FFmpeg's av1_nvenc, av1_amf,
+    // libsvtav1 and libaom-av1 wrappers ignore that side data, so they get no hint and only benefit from skipped frames.
+    void SetRegionsOfInterest(const std::vector<RECT>& rects) { if (roiHints) roiRects = rects; }
+
+    int64_t GetBitrate() const { return codecContext->bit_rate; }
+    uint64_t GetEncoded() const { return encodedCount; }
+    uint64_t GetFailed() const { return failedCount; }
+    // Software readback totals: count, summed submit-to-map latency, and how many had to wait
+    uint64_t GetReadbacks() const { return readbackCount; }
+    uint64_t GetReadbackUs() const { return readbackUs; }
+    uint64_t GetReadbackStalls() const { return readbackStalls; }
+    bool IsHardware() const { return useHardware; }
+    const char* GetCodecName() const { return codecContext->codec->name; }
+    bool UsesIntraRefresh() const { return intraRefresh; }
     int GetWidth() const { return width; }
     int GetHeight() const { return height; }
+    int GetFPS() const { return codecContext->framerate.num; }
+    ID3D11Texture2D* GetPool() const { return poolTexture; }
 };
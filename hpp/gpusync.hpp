@@ -0,0 +1,130 @@
+/**
+ * @file gpusync.hpp
+ * @brief Shared GPU timeline for capture and encoder with event-driven waits
+ * @copyright 2025-2026 Daniel Chrobak
+ */
+
+#pragma once
+#include "common.hpp"
+#include "metrics.hpp"
+
+class GPUSync {
+private:
+    static constexpr int QUERY_RING = 16;
+    static constexpr int64_t POLL_INTERVAL_100NS = 2500;
+
+    struct WaitHandles {
+        HANDLE event = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+        HANDLE timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        WaitHandles() { if (!timer) timer = CreateWaitableTimerW(nullptr, FALSE, nullptr); }
+        ~WaitHandles() { if (event) CloseHandle(event); if (timer) CloseHandle(timer); }
+    };
+
+    ID3D11Device5* device5 = nullptr;
+    ID3D11DeviceContext4* context4 = nullptr;
+    ID3D11Fence* fence = nullptr;
+    ID3D11Query* queries[QUERY_RING] = {};
+    std::atomic<uint64_t> issued[QUERY_RING] = {};
+    std::atomic<uint64_t> signalValue{0}, completedValue{0};
+    std::atomic<uint64_t> waitCount{0}, waitUs{0}, timeoutCount{0};
+    bool useFence = false;
+
+    static inline const int64_t queryFrequency = [] {
+        LARGE_INTEGER f; QueryPerformanceFrequency(&f); return f.QuadPart;
+    }();
+
+    // SetEventOnCompletion targets one handle, so every waiting thread gets its own event and timer
+    static WaitHandles& Handles() { static thread_local WaitHandles h; return h; }
+
+    void Advance(uint64_t value) {
+        uint64_t cur = completedValue.load();
+        while (value > cur && !completedValue.compare_exchange_weak(cur, value)) {}
+    }
+
+    // A slot reissued for a later value still proves this one done, since the GPU retires work in order
+    bool PollQuery(uint64_t value, ID3D11DeviceContext* context) {
+        int slot = static_cast<int>(value % QUERY_RING);
+        uint64_t tag = issued[slot].load();
+        if (context->GetData(queries[slot], nullptr, 0, D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK) return false;
+        Advance(tag);
+        return tag >= value;
+    }
+
+public:
+    bool Init(ID3D11Device* device, ID3D11DeviceContext* context) {
+        if (SUCCEEDED(device->QueryInterface(IID_PPV_ARGS(&device5))) &&
+            SUCCEEDED(context->QueryInterface(IID_PPV_ARGS(&context4))) &&
+            SUCCEEDED(device5->CreateFence(0, D3D11_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence)))) {
+            useFence = true;
+            LOG("GPU sync: Fence");
+            return true;
+        }
+        SafeRelease(device5, context4, fence);
+        D3D11_QUERY_DESC qd = {D3D11_QUERY_EVENT, 0};
+        for (auto& q : queries)
+            if (FAILED(device->CreateQuery(&qd, &q))) { for (auto& r : queries) SafeRelease(r); return false; }
+        LOG("GPU sync: Query ring");
+        return true;
+    }
+
+    ~GPUSync() { SafeRelease(fence, context4, device5); for (auto& q : queries) SafeRelease(q); }
+
+    // Call with the device multithread lock held so timeline values follow submission order
+    uint64_t Signal(ID3D11DeviceContext* context) {
+        uint64_t value = ++signalValue;
+        if (useFence) context4->Signal(fence, value);
+        else { int slot = static_cast<int>(value % QUERY_RING); issued[slot] = value; context->End(queries[slot]); }
+        return value;
+    }
+
+    bool IsComplete(uint64_t value, ID3D11DeviceContext* context) {
+        if (!value || value <= completedValue) return true;
+        if (useFence) { uint64_t done = fence->GetCompletedValue(); Advance(done); return done >= value; }
+        return PollQuery(value, context);
+    }
+
+    bool Wait(uint64_t value, ID3D11DeviceContext* context, DWORD timeoutMs = 5) {
+        if (IsComplete(value, context)) return true;
+        LARGE_INTEGER start, now;
+        QueryPerformanceCounter(&start);
+        auto& h = Handles();
+        bool done = false;
+        int64_t deadline = start.QuadPart + queryFrequency * timeoutMs / 1000;
+
+        if (useFence) {
+            // A wait that timed out earlier leaves its registration armed on the same auto-reset event, so a wake only
+            // counts once this value has really completed
+            ResetEvent(h.event);
+            if (SUCCEEDED(fence->SetEventOnCompletion(value, h.event))) {
+                while (!(done = IsComplete(value, context))) {
+                    QueryPerformanceCounter(&now);
+                    if (now.QuadPart >= deadline) break;
+                    if (WaitForSingleObject(h.event, static_cast<DWORD>((deadline - now.QuadPart) * 1000 / queryFrequency) + 1) != WAIT_OBJECT_0) { done = IsComplete(value, context); break; }
+                }
+            } else done = IsComplete(value, context);
+        } else {
+            // No fence: sleep in short timer slices between polls instead of spinning on GetData
+            LARGE_INTEGER due; due.QuadPart = -POLL_INTERVAL_100NS;
+            context->Flush();
+            while (!(done = IsComplete(value, context))) {
+                QueryPerformanceCounter(&now);
+                if (now.QuadPart >= deadline) break;
+                if (SetWaitableTimer(h.timer, &due, 0, nullptr, nullptr, FALSE)) WaitForSingleObject(h.timer, timeoutMs);
+                else Sleep(1);
+            }
+        }
+
+        QueryPerformanceCounter(&now);
+        uint64_t us = static_cast<uint64_t>((now.QuadPart - start.QuadPart) * 1000000 / queryFrequency);
+        waitCount++;
+        waitUs += us;
+        g_gpuWaitLatency.Observe(static_cast<int64_t>(us));
+        if (!done) timeoutCount++;
+        return done;
+    }
+
+    bool UsesFence() const { return useFence; }
+    uint64_t GetWaits() const { return waitCount; }
+    uint64_t GetWaitUs() const { return waitUs; }
+    uint64_t GetTimeouts() const { return timeoutCount; }
+};
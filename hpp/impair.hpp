@@ -0,0 +1,99 @@
+/**
+ * @file impair.hpp
+ * @brief Emulated network link (loss, delay, jitter, bandwidth cap) in front of a DataChannel for loopback benchmarks
+ * @copyright 2025-2026 Daniel Chrobak
+ */
+
+#pragma once
+#include "common.hpp"
+#include <random>
+#include <map>
+
+struct LinkProfile {
+    double lossPct = 0;
+    int delayMs = 0, jitterMs = 0;
+    int64_t bandwidthBps = 0;  // 0 = uncapped
+    bool IsActive() const { return lossPct > 0 || delayMs > 0 || jitterMs > 0 || bandwidthBps > 0; }
+};
+
+// Packets are serialized at the capped rate in send order, then delivered after delay plus jitter, so jitter can
+// reorder them like a real path. Bytes still waiting for the bottleneck count as Backlog(), which callers add to
+// bufferedAmount so the real drop and congestion logic reacts to the cap.
+class LinkImpairment {
+private:
+    const LinkProfile profile;
+    std::shared_ptr<rtc::DataChannel> channel;
+    std::multimap<int64_t, rtc::binary> inFlight;  // by delivery time
+    std::deque<std::pair<int64_t, size_t>> serializing;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::mt19937 rng{std::random_device{}()};
+    int64_t linkFreeUs = 0;
+    size_t backlog = 0;
+    std::atomic<uint64_t> lostCount{0};
+    bool stopping = false;
+    std::thread worker;
+
+    void DrainSerialized(int64_t now) {
+        while (!serializing.empty() && serializing.front().first <= now) { backlog -= serializing.front().second; serializing.pop_front(); }
+    }
+
+    void Run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping) {
+            if (inFlight.empty()) { cv.wait(lock); continue; }
+            int64_t wait = inFlight.begin()->first - GetTimestamp();
+            if (wait > 0) { cv.wait_for(lock, microseconds(wait)); continue; }
+            auto node = inFlight.extract(inFlight.begin());
+            auto ch = channel;
+            lock.unlock();
+            try { if (ch && ch->isOpen()) ch->send(std::move(node.mapped())); } catch (...) {}
+            lock.lock();
+        }
+    }
+
+public:
+    explicit LinkImpairment(const LinkProfile& p) : profile(p), worker([this] { Run(); }) {}
+
+    ~LinkImpairment() {
+        { std::lock_guard<std::mutex> lock(mutex); stopping = true; }
+        cv.notify_all();
+        if (worker.joinable()) worker.join();
+    }
+
+    LinkImpairment(const LinkImpairment&) = delete;
+    LinkImpairment& operator=(const LinkImpairment&) = delete;
+
+    void Attach(std::shared_ptr<rtc::DataChannel> ch) { std::lock_guard<std::mutex> lock(mutex); channel = std::move(ch); }
+
+    void Send(const void* data, size_t len) {
+        rtc::binary msg(len);
+        memcpy(msg.data(), data, len);
+        Send(std::move(msg));
+    }
+
+    // Always accepts; a lost packet still occupies the bottleneck before it vanishes
+    void Send(rtc::binary&& msg) {
+        size_t len = msg.size();
+        int64_t now = GetTimestamp();
+        std::lock_guard<std::mutex> lock(mutex);
+        DrainSerialized(now);
+        int64_t start = std::max(now, linkFreeUs);
+        linkFreeUs = profile.bandwidthBps > 0 ? start + static_cast<int64_t>(len) * 8 * 1000000 / profile.bandwidthBps : start;
+        serializing.emplace_back(linkFreeUs, len);
+        backlog += len;
+
+        if (profile.lossPct > 0 && std::uniform_real_distribution<double>(0, 100)(rng) < profile.lossPct) { lostCount++; return; }
+        int64_t jitter = profile.jitterMs > 0 ? std::uniform_int_distribution<int64_t>(0, profile.jitterMs * 1000LL)(rng) : 0;
+        inFlight.emplace(linkFreeUs + profile.delayMs * 1000LL + jitter, std::move(msg));
+        cv.notify_one();
+    }
+
+    size_t Backlog() {
+        std::lock_guard<std::mutex> lock(mutex);
+        DrainSerialized(GetTimestamp());
+        return backlog;
+    }
+
+    uint64_t GetLost() const { return lostCount; }
+};
@@ -6,9 +6,13 @@
 
 #pragma once
 #include "common.hpp"
+#include "trace.hpp"
+#include "protocol.hpp"
 
 #pragma pack(push, 1)
 struct MouseMoveMsg { uint32_t magic; float x, y; };
+// Raw pointer-locked deltas in pixels, for games that read relative motion
+struct MouseRelMsg { uint32_t magic; int16_t dx, dy; };
 struct MouseBtnMsg { uint32_t magic; uint8_t button, action; };
 struct MouseWheelMsg { uint32_t magic; int16_t deltaX, deltaY; float x, y; };
 struct KeyMsg { uint32_t magic; uint16_t keyCode, scanCode; uint8_t action, modifiers; };
@@ -37,17 +41,106 @@ inline WORD JsKeyToVK(uint16_t keyCode) {
     return it != keyMap.end() ? it->second : 0;
 }
 
+// Messages arrive on libdatachannel's thread and only queue INPUTs; a dedicated thread injects whatever piled up with
+// one SendInput. Consecutive moves collapse into the latest (absolute) or their sum (relative) while it is busy.
 class InputHandler {
 private:
+    static constexpr DWORD ABSOLUTE_MOVE = MOUSEEVENTF_MOVE | MOUSEEVENTF_ABSOLUTE | MOUSEEVENTF_VIRTUALDESK;
+    // Each button's up flag is its down flag shifted left once
+    static constexpr DWORD BUTTON_DOWNS = MOUSEEVENTF_LEFTDOWN | MOUSEEVENTF_RIGHTDOWN | MOUSEEVENTF_MIDDLEDOWN | MOUSEEVENTF_XDOWN;
+    static constexpr DWORD BUTTON_UPS = BUTTON_DOWNS << 1;
+
     std::atomic<int> monitorX{0}, monitorY{0}, monitorWidth{1920}, monitorHeight{1080};
-    std::atomic<bool> enabled{false};
-    std::atomic<uint64_t> moveCount{0}, clickCount{0}, keyCount{0};
+    // Virtual desktop bounds, refreshed on WM_DISPLAYCHANGE instead of queried per event
+    std::atomic<int> desktopX{0}, desktopY{0}, desktopWidth{1}, desktopHeight{1};
+    std::atomic<bool> enabled{false}, running{false};
+    std::atomic<uint64_t> moveCount{0}, clickCount{0}, keyCount{0}, batchCount{0};
+
+    std::mutex mutex;
+    std::vector<INPUT> queue;
+    // The release for every key and button queued down and not yet up, so a hand-over never leaves one stuck;
+    // draining lets the worker inject those after Disable
+    std::vector<INPUT> held;
+    bool draining = false;
+    HANDLE queueEvent = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+    std::thread worker;
+
+    void RefreshDesktop() {
+        desktopX = GetSystemMetrics(SM_XVIRTUALSCREEN); desktopY = GetSystemMetrics(SM_YVIRTUALSCREEN);
+        desktopWidth = std::max(1, GetSystemMetrics(SM_CXVIRTUALSCREEN)); desktopHeight = std::max(1, GetSystemMetrics(SM_CYVIRTUALSCREEN));
+    }
 
     void ToAbsolute(float nx, float ny, LONG& ax, LONG& ay) {
         int px = monitorX + static_cast<int>(std::clamp(nx, 0.f, 1.f) * monitorWidth);
         int py = monitorY + static_cast<int>(std::clamp(ny, 0.f, 1.f) * monitorHeight);
-        ax = static_cast<LONG>((px - GetSystemMetrics(SM_XVIRTUALSCREEN)) * 65535 / GetSystemMetrics(SM_CXVIRTUALSCREEN));
-        ay = static_cast<LONG>((py - GetSystemMetrics(SM_YVIRTUALSCREEN)) * 65535 / GetSystemMetrics(SM_CYVIRTUALSCREEN));
+        ax = static_cast<LONG>(static_cast<int64_t>(px - desktopX) * 65535 / desktopWidth);
+        ay = static_cast<LONG>(static_cast<int64_t>(py - desktopY) * 65535 / desktopHeight);
+    }
+
+    static bool IsPress(const INPUT& in) { return in.type == INPUT_KEYBOARD ? !(in.ki.dwFlags & KEYEVENTF_KEYUP) : (in.mi.dwFlags & BUTTON_DOWNS) != 0; }
+    static bool IsRelease(const INPUT& in) { return in.type == INPUT_KEYBOARD ? (in.ki.dwFlags & KEYEVENTF_KEYUP) != 0 : (in.mi.dwFlags & BUTTON_UPS) != 0; }
+    static bool SameControl(const INPUT& a, const INPUT& b) {
+        return a.type == b.type && (a.type == INPUT_KEYBOARD ? a.ki.wVk == b.ki.wVk : a.mi.dwFlags == b.mi.dwFlags && a.mi.mouseData == b.mi.mouseData);
+    }
+
+    void Push(const INPUT& in) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!enabled) return;
+            if (IsPress(in) || IsRelease(in)) {
+                INPUT up = in;
+                if (up.type == INPUT_KEYBOARD) up.ki.dwFlags |= KEYEVENTF_KEYUP;
+                else if (IsPress(in)) up.mi.dwFlags = in.mi.dwFlags << 1;
+                std::erase_if(held, [&up](const INPUT& h) { return SameControl(h, up); });
+                if (IsPress(in)) held.push_back(up);
+            }
+            INPUT* last = queue.empty() ? nullptr : &queue.back();
+            bool move = in.type == INPUT_MOUSE && (in.mi.dwFlags == ABSOLUTE_MOVE || in.mi.dwFlags == MOUSEEVENTF_MOVE);
+            if (move && last && last->type == INPUT_MOUSE && last->mi.dwFlags == in.mi.dwFlags) {
+                if (in.mi.dwFlags == ABSOLUTE_MOVE) { last->mi.dx = in.mi.dx; last->mi.dy = in.mi.dy; }
+                else { last->mi.dx += in.mi.dx; last->mi.dy += in.mi.dy; }
+            } else queue.push_back(in);
+        }
+        SetEvent(queueEvent);
+    }
+
+    template<typename T> static T Read(const uint8_t* data) { T m; memcpy(&m, data, sizeof(T)); return m; }
+    void OnMouseMove(const uint8_t* d, size_t) { auto m = Read<MouseMoveMsg>(d); MouseMove(m.x, m.y); }
+    void OnMouseRel(const uint8_t* d, size_t) { auto m = Read<MouseRelMsg>(d); MouseMoveRelative(m.dx, m.dy); }
+    void OnMouseButton(const uint8_t* d, size_t) { auto m = Read<MouseBtnMsg>(d); MouseButton(m.button, m.action != 0); }
+    void OnMouseWheel(const uint8_t* d, size_t) { int16_t v[2]; memcpy(v, d + 4, 4); MouseWheel(v[0], v[1]); }
+    void OnKey(const uint8_t* d, size_t) { auto m = Read<KeyMsg>(d); Key(m.keyCode, m.scanCode, m.action != 0, m.modifiers); }
+
+    static LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp) {
+        if (msg == WM_DISPLAYCHANGE)
+            if (auto* self = reinterpret_cast<InputHandler*>(GetWindowLongPtrW(hwnd, GWLP_USERDATA))) self->RefreshDesktop();
+        return DefWindowProcW(hwnd, msg, wp, lp);
+    }
+
+    void Run() {
+        SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+        Trace::NameThread("input");
+        // Hidden top-level window: message-only windows never get the WM_DISPLAYCHANGE broadcast
+        WNDCLASSW wc{};
+        wc.lpfnWndProc = WndProc; wc.hInstance = GetModuleHandleW(nullptr); wc.lpszClassName = L"SlipStreamInput";
+        RegisterClassW(&wc);
+        HWND hwnd = CreateWindowExW(0, wc.lpszClassName, L"", 0, 0, 0, 0, 0, nullptr, nullptr, wc.hInstance, nullptr);
+        if (hwnd) SetWindowLongPtrW(hwnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(this));
+        else WARN("Input: no display change window, desktop bounds stay fixed");
+        RefreshDesktop();
+
+        std::vector<INPUT> batch;
+        while (running) {
+            MsgWaitForMultipleObjects(1, &queueEvent, FALSE, 100, QS_ALLINPUT);
+            MSG msg;
+            while (PeekMessageW(&msg, nullptr, 0, 0, PM_REMOVE)) DispatchMessageW(&msg);
+            bool inject;
+            { std::lock_guard<std::mutex> lock(mutex); batch.swap(queue); inject = enabled || std::exchange(draining, false); }
+            if (batch.empty()) continue;
+            if (inject) { SendInput(static_cast<UINT>(batch.size()), batch.data(), sizeof(INPUT)); batchCount++; }
+            batch.clear();
+        }
+        if (hwnd) DestroyWindow(hwnd);
     }
 
     static bool IsExtendedKey(WORD vk) {
@@ -58,6 +151,13 @@ private:
     }
 
 public:
+    ~InputHandler() {
+        running = false;
+        if (queueEvent) SetEvent(queueEvent);
+        if (worker.joinable()) worker.join();
+        if (queueEvent) CloseHandle(queueEvent);
+    }
+
     void SetMonitorBounds(int x, int y, int w, int h) { monitorX = x; monitorY = y; monitorWidth = w; monitorHeight = h; }
 
     void UpdateFromMonitorInfo(const MonitorInfo& info) {
@@ -67,32 +167,41 @@ public:
                              mi.rcMonitor.right - mi.rcMonitor.left, mi.rcMonitor.bottom - mi.rcMonitor.top);
     }
 
-    void Enable() { enabled = true; LOG("Input enabled"); }
-    void Disable() { enabled = false; }
-    bool IsEnabled() const { return enabled; }
-
-    void WiggleCenter() {
-        if (!enabled) return;
-        LONG ax, ay; ToAbsolute(0.5f, 0.5f, ax, ay);
-        INPUT inputs[3] = {};
-        DWORD flags = MOUSEEVENTF_MOVE | MOUSEEVENTF_ABSOLUTE | MOUSEEVENTF_VIRTUALDESK;
-        for (int i = 0; i < 3; i++) {
-            inputs[i].type = INPUT_MOUSE;
-            inputs[i].mi.dwFlags = flags;
-            inputs[i].mi.dx = ax + (i == 1 ? 1 : 0);
-            inputs[i].mi.dy = ay;
+    void Enable() {
+        enabled = true;
+        if (!running.exchange(true)) worker = std::thread([this] { Run(); });
+        LOG("Input enabled");
+    }
+    // Queued presses and moves are dropped; queued releases go out, followed by releases for anything still held
+    void Disable() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            enabled = false;
+            std::erase_if(queue, [](const INPUT& in) { return !IsRelease(in); });
+            queue.insert(queue.end(), held.rbegin(), held.rend());
+            held.clear();
+            if (!(draining = !queue.empty())) return;
         }
-        SendInput(3, inputs, sizeof(INPUT));
-        LOG("Cursor wiggled at center to trigger keyframe");
+        SetEvent(queueEvent);
     }
+    bool IsEnabled() const { return enabled; }
 
     void MouseMove(float nx, float ny) {
         if (!enabled) return;
         LONG ax, ay; ToAbsolute(nx, ny, ax, ay);
         INPUT in{INPUT_MOUSE};
-        in.mi.dwFlags = MOUSEEVENTF_MOVE | MOUSEEVENTF_ABSOLUTE | MOUSEEVENTF_VIRTUALDESK;
+        in.mi.dwFlags = ABSOLUTE_MOVE;
         in.mi.dx = ax; in.mi.dy = ay;
-        SendInput(1, &in, sizeof(INPUT));
+        Push(in);
+        moveCount++;
+    }
+
+    void MouseMoveRelative(int16_t dx, int16_t dy) {
+        if (!enabled || (!dx && !dy)) return;
+        INPUT in{INPUT_MOUSE};
+        in.mi.dwFlags = MOUSEEVENTF_MOVE;
+        in.mi.dx = dx; in.mi.dy = dy;
+        Push(in);
         moveCount++;
     }
 
@@ -106,14 +215,14 @@ public:
         INPUT in{INPUT_MOUSE};
         in.mi.dwFlags = flags[button][down ? 1 : 0];
         if (button >= 3) in.mi.mouseData = button == 3 ? XBUTTON1 : XBUTTON2;
-        SendInput(1, &in, sizeof(INPUT));
+        Push(in);
         clickCount++;
     }
 
     void MouseWheel(int16_t dx, int16_t dy) {
         if (!enabled) return;
-        if (dy) { INPUT in{INPUT_MOUSE}; in.mi.dwFlags = MOUSEEVENTF_WHEEL; in.mi.mouseData = static_cast<DWORD>(-dy * WHEEL_DELTA / 100); SendInput(1, &in, sizeof(INPUT)); }
-        if (dx) { INPUT in{INPUT_MOUSE}; in.mi.dwFlags = MOUSEEVENTF_HWHEEL; in.mi.mouseData = static_cast<DWORD>(dx * WHEEL_DELTA / 100); SendInput(1, &in, sizeof(INPUT)); }
+        if (dy) { INPUT in{INPUT_MOUSE}; in.mi.dwFlags = MOUSEEVENTF_WHEEL; in.mi.mouseData = static_cast<DWORD>(-dy * WHEEL_DELTA / 100); Push(in); }
+        if (dx) { INPUT in{INPUT_MOUSE}; in.mi.dwFlags = MOUSEEVENTF_HWHEEL; in.mi.mouseData = static_cast<DWORD>(dx * WHEEL_DELTA / 100); Push(in); }
     }
 
     void Key(uint16_t jsKey, uint16_t scanCode, bool down, uint8_t) {
@@ -124,29 +233,27 @@ public:
         in.ki.wVk = vk;
         in.ki.wScan = scanCode ? scanCode : static_cast<WORD>(MapVirtualKey(vk, MAPVK_VK_TO_VSC));
         in.ki.dwFlags = (down ? 0 : KEYEVENTF_KEYUP) | (IsExtendedKey(vk) ? KEYEVENTF_EXTENDEDKEY : 0);
-        SendInput(1, &in, sizeof(INPUT));
+        Push(in);
         keyCount++;
     }
 
     bool HandleMessage(const uint8_t* data, size_t len) {
+        using R = Route<InputHandler>;
+        static constexpr auto routes = MakeRoutes<InputHandler>({
+            {MSG_MOUSE_MOVE, sizeof(MouseMoveMsg), 0, &InputHandler::OnMouseMove},
+            {MSG_MOUSE_REL, sizeof(MouseRelMsg), 0, &InputHandler::OnMouseRel},
+            {MSG_MOUSE_BTN, sizeof(MouseBtnMsg), 0, &InputHandler::OnMouseButton},
+            {MSG_MOUSE_WHEEL, 8, 0, &InputHandler::OnMouseWheel},
+            {MSG_KEY, sizeof(KeyMsg), 0, &InputHandler::OnKey},
+        });
         if (len < 4) return false;
-        uint32_t magic = *reinterpret_cast<const uint32_t*>(data);
-
-        if (magic == MSG_MOUSE_MOVE && len >= sizeof(MouseMoveMsg)) {
-            auto* m = reinterpret_cast<const MouseMoveMsg*>(data); MouseMove(m->x, m->y); return true;
-        }
-        if (magic == MSG_MOUSE_BTN && len >= sizeof(MouseBtnMsg)) {
-            auto* m = reinterpret_cast<const MouseBtnMsg*>(data); MouseButton(m->button, m->action != 0); return true;
-        }
-        if (magic == MSG_MOUSE_WHEEL && len >= 8) {
-            auto* m = reinterpret_cast<const MouseWheelMsg*>(data); MouseWheel(m->deltaX, m->deltaY); return true;
-        }
-        if (magic == MSG_KEY && len >= sizeof(KeyMsg)) {
-            auto* m = reinterpret_cast<const KeyMsg*>(data); Key(m->keyCode, m->scanCode, m->action != 0, m->modifiers); return true;
-        }
-        return false;
+        uint32_t magic; memcpy(&magic, data, 4);
+        const R* r = routes.Find(magic, len);
+        if (!r) return false;
+        (this->*r->handler)(data, len);
+        return true;
     }
 
-    struct Stats { uint64_t moves, clicks, keys; };
-    Stats GetStats() { return {moveCount.exchange(0), clickCount.exchange(0), keyCount.exchange(0)}; }
+    struct Stats { uint64_t moves, clicks, keys, batches; };
+    Stats GetStats() const { return {moveCount, clickCount, keyCount, batchCount}; }
 };
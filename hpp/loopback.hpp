@@ -0,0 +1,323 @@
+/**
+ * @file loopback.hpp
+ * @brief Headless viewer for loopback benchmarks: signaling, auth and the browser's frame reassembly without decoding
+ * @copyright 2025-2026 Daniel Chrobak
+ */
+
+#pragma once
+#include "common.hpp"
+#include "packetizer.hpp"
+#include "impair.hpp"
+#include <map>
+
+// Mirrors handleMsg/tryDrop/processFrame in js/network.js, constants from C in js/state.js; keep the two in step
+// so a loopback run predicts what a browser viewer sees. Frames are reassembled and counted, never decoded.
+class LoopbackClient {
+public:
+    static constexpr int PING_MS = 200, REPORT_MS = 1000, MAX_FRAMES = 6, FRAME_TIMEOUT_MS = 100, MAX_NACKS = 2, NACK_MIN_MS = 30, MAX_HELD = 30, LOSS_MIN_MS = 50;
+
+    struct Stats {
+        uint64_t complete = 0, decoded = 0, dropped = 0, waitingKey = 0, keyRequests = 0, nacks = 0, lossReports = 0, fecRecovered = 0, chunks = 0, chunksLost = 0;
+        std::vector<int64_t> latencyUs;  // capture to reassembled, same host clock as the server
+    };
+
+private:
+    struct Frame {
+        std::vector<std::vector<uint8_t>> parts, parity;
+        size_t total = 0, received = 0, raw = 0, fec = 0;
+        int64_t capTs = 0;
+        double firstTime = 0, nackAt = 0;
+        int nacks = 0;
+        bool isKey = false;
+    };
+
+    std::shared_ptr<rtc::PeerConnection> peerConnection;
+    std::shared_ptr<rtc::DataChannel> dataChannel;
+    std::unique_ptr<LinkImpairment> upstream;
+    std::string username, pin;
+    int fps;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::map<uint32_t, Frame> frames;
+    std::vector<int64_t> held;
+    int64_t pendingKey = -1, epochUs = 0;
+    int stream = -1;
+    uint32_t lastFrameId = 0, lastGoodFid = 0;
+    double rtt = 0, lastLossAt = -1e9;
+    bool needKey = true, gathered = false, authFailed = false, streaming = false;
+    Stats stats, reportRef;
+
+    std::atomic<bool> running{true};
+    std::thread timer;
+
+    static double NowMs() { return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count(); }
+    static bool IsNewer(uint32_t n, uint32_t l) { uint32_t d = n - l; return d > 0 && d < 0x80000000u; }
+
+    bool SendMsg(const void* data, size_t len) {
+        auto ch = dataChannel;
+        if (!ch || !ch->isOpen()) return false;
+        if (upstream) { upstream->Send(data, len); return true; }
+        try { ch->send(reinterpret_cast<const std::byte*>(data), len); return true; } catch (...) { return false; }
+    }
+
+    template<size_t N> bool SendBuf(const uint8_t (&buf)[N]) { return SendMsg(buf, N); }
+
+    void ReqKey() {
+        uint32_t magic = MSG_REQUEST_KEY;
+        if (SendMsg(&magic, 4)) stats.keyRequests++;
+    }
+
+    void SendFrameLoss(uint32_t id) {
+        double now = NowMs();
+        if (now - lastLossAt < LOSS_MIN_MS) return;
+        uint8_t buf[12]; uint32_t magic = MSG_FRAME_LOSS;
+        memcpy(buf, &magic, 4); memcpy(buf + 4, &lastGoodFid, 4); memcpy(buf + 8, &id, 4);
+        if (SendBuf(buf)) { lastLossAt = now; stats.lossReports++; }
+    }
+
+    bool SendNack(uint32_t id, Frame& fr, double rt) {
+        if (fr.nackAt > 0 && rt - fr.nackAt < std::max<double>(NACK_MIN_MS, rtt * 1.5)) return true;
+        if (fr.nacks >= MAX_NACKS) return false;
+        std::vector<uint16_t> miss;
+        for (size_t i = 0; i < fr.total && miss.size() < 512; i++) if (fr.parts[i].empty()) miss.push_back(static_cast<uint16_t>(i));
+        std::vector<uint8_t> buf(10 + miss.size() * 2);
+        uint32_t magic = MSG_NACK; uint16_t count = static_cast<uint16_t>(miss.size());
+        memcpy(buf.data(), &magic, 4); memcpy(buf.data() + 4, &id, 4); memcpy(buf.data() + 8, &count, 2);
+        if (!miss.empty()) memcpy(buf.data() + 10, miss.data(), miss.size() * 2);
+        if (!SendMsg(buf.data(), buf.size())) return false;
+        fr.nacks++; fr.nackAt = rt; pendingKey = id; stats.nacks++;
+        return true;
+    }
+
+    void DropHeld() { stats.dropped += held.size(); held.clear(); pendingKey = -1; }
+    void CountChunks(const Frame& fr) { stats.chunks += fr.total; stats.chunksLost += fr.total - fr.raw; }
+
+    void RecoverGroup(Frame& fr, size_t g) {
+        if (!fr.fec || g >= fr.parity.size() || fr.parity[g].size() < 2) return;
+        const auto& par = fr.parity[g];
+        size_t lo = g * fr.fec, hi = std::min(lo + fr.fec, fr.total), miss = SIZE_MAX;
+        for (size_t i = lo; i < hi; i++) if (fr.parts[i].empty()) { if (miss != SIZE_MAX) return; miss = i; }
+        if (miss == SIZE_MAX) return;
+
+        std::vector<uint8_t> out(par.begin() + 2, par.end());
+        size_t len = par[0] | (par[1] << 8);
+        for (size_t i = lo; i < hi; i++) {
+            if (i == miss) continue;
+            const auto& p = fr.parts[i];
+            len ^= p.size();
+            for (size_t j = 0; j < p.size() && j < out.size(); j++) out[j] ^= p[j];
+        }
+        if (len > out.size()) return;
+        out.resize(len);
+        fr.parts[miss] = std::move(out);
+        fr.received++;
+        stats.fecRecovered++;
+    }
+
+    // The decoder drops deltas until a keyframe arrives after any gap (media.js decodeFrame)
+    void Decode(uint32_t fid, int64_t capTs, bool isKey) {
+        if (!isKey && needKey) { stats.waitingKey++; return; }
+        if (isKey) needKey = false;
+        lastGoodFid = fid;
+        stats.decoded++;
+        stats.latencyUs.push_back(GetTimestamp() - capTs);
+    }
+
+    void ProcessFrame(uint32_t fid) {
+        auto it = frames.find(fid);
+        if (it == frames.end()) return;
+        Frame& fr = it->second;
+        if (std::any_of(fr.parts.begin(), fr.parts.end(), [](const auto& p) { return p.empty(); })) { frames.erase(it); stats.dropped++; return; }
+
+        CountChunks(fr);
+        stats.complete++;
+        if (fid > lastFrameId) lastFrameId = fid;
+        int64_t capTs = fr.capTs;
+        bool isKey = fr.isKey;
+        std::vector<int64_t> release;
+
+        if (isKey && pendingKey >= 0) {
+            if (fid == pendingKey) { release.swap(held); pendingKey = -1; }
+            else { frames.erase(static_cast<uint32_t>(pendingKey)); DropHeld(); }
+        } else if (pendingKey >= 0) {
+            held.push_back(capTs);
+            if (held.size() > MAX_HELD) { DropHeld(); needKey = true; ReqKey(); }
+            frames.erase(fid);
+            return;
+        }
+
+        frames.erase(fid);
+        Decode(fid, capTs, isKey);
+        for (int64_t ts : release) Decode(fid, ts, false);
+    }
+
+    void TryDrop(uint32_t id, double rt) {
+        auto it = frames.find(id);
+        if (it == frames.end()) return;
+        Frame& fr = it->second;
+        if (fr.received == fr.total) { ProcessFrame(id); return; }
+        if (fr.isKey && SendNack(id, fr, rt)) return;
+        bool isKey = fr.isKey;
+        CountChunks(fr);
+        frames.erase(it);
+        stats.dropped++;
+        if (isKey) { DropHeld(); needKey = true; ReqKey(); }
+        else SendFrameLoss(id);
+    }
+
+    void HandleVideo(const uint8_t* d, size_t len, double rt) {
+        PacketHeader h;
+        size_t hlen = h.Read(d, len, epochUs);
+        if (!hlen) return;
+        uint32_t fid = h.frameId;
+        if (lastFrameId > 0 && !IsNewer(fid, lastFrameId) && fid != lastFrameId && static_cast<int64_t>(fid) != pendingKey) return;
+
+        if (h.stream != stream) {
+            if (!(h.frameType & Packetizer::FRAME_KEY) || (lastFrameId > 0 && !IsNewer(fid, lastFrameId))) return;
+            stream = h.stream;
+            for (auto it = frames.begin(); it != frames.end();) it = it->first != fid && !IsNewer(it->first, fid) ? frames.erase(it) : std::next(it);
+        }
+
+        std::vector<uint32_t> ids;
+        for (const auto& [id, fr] : frames) if (fr.received < fr.total && rt - fr.firstTime > FRAME_TIMEOUT_MS) ids.push_back(id);
+        for (uint32_t id : ids) TryDrop(id, rt);
+
+        if (!frames.count(fid)) {
+            ids.clear();
+            for (const auto& [id, fr] : frames) if (IsNewer(fid, id) && fr.received < fr.total) ids.push_back(id);
+            for (uint32_t id : ids) TryDrop(id, rt);
+
+            Frame& nf = frames[fid];
+            nf.total = h.totalChunks; nf.fec = h.fecGroup; nf.capTs = h.timestamp; nf.firstTime = rt; nf.isKey = (h.frameType & Packetizer::FRAME_KEY) != 0;
+            nf.parts.resize(nf.total);
+            if (nf.fec) nf.parity.resize((nf.total + nf.fec - 1) / nf.fec);
+
+            if (frames.size() > MAX_FRAMES) {
+                int64_t victim = -1; double age = 0;
+                for (int pass = 0; pass < 2 && victim < 0; pass++)
+                    for (const auto& [id, fr] : frames)
+                        if (id != fid && fr.received != fr.total && rt - fr.firstTime > age && (pass || !fr.isKey)) { age = rt - fr.firstTime; victim = id; }
+                if (victim >= 0) TryDrop(static_cast<uint32_t>(victim), rt);
+            }
+        }
+
+        auto it = frames.find(fid);
+        if (it == frames.end()) return;
+        Frame& fr = it->second;
+        std::vector<uint8_t> chunk(d + hlen, d + len);
+        size_t cidx = h.chunkIndex;
+        if (h.frameType & Packetizer::FRAME_FEC) {
+            if (cidx >= fr.parity.size() || !fr.parity[cidx].empty() || fr.received == fr.total) return;
+            fr.parity[cidx] = std::move(chunk);
+            RecoverGroup(fr, cidx);
+        } else {
+            if (cidx >= fr.total || !fr.parts[cidx].empty() || chunk.empty()) return;
+            fr.parts[cidx] = std::move(chunk);
+            fr.received++;
+            if (!(h.frameType & Packetizer::FRAME_RTX)) fr.raw++;
+            if (fr.fec) RecoverGroup(fr, cidx / fr.fec);
+        }
+        if (fr.received == fr.total) ProcessFrame(fid);
+    }
+
+    void HandleMessage(const rtc::binary& msg) {
+        double rt = NowMs();
+        auto* d = reinterpret_cast<const uint8_t*>(msg.data());
+        size_t len = msg.size();
+        if (len < 4) return;
+        uint32_t mg; memcpy(&mg, d, 4);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (mg == MSG_AUTH_RESPONSE && len >= 6) {
+            if (d[4] != 1) authFailed = true;
+            else {
+                uint8_t buf[7]; uint32_t magic = MSG_FPS_SET; uint16_t f = static_cast<uint16_t>(fps);
+                memcpy(buf, &magic, 4); memcpy(buf + 4, &f, 2); buf[6] = 0;
+                SendBuf(buf);
+            }
+            cv.notify_all();
+            return;
+        }
+        if (mg == MSG_PING && len == 24) { uint64_t cs; memcpy(&cs, d + 8, 8); rtt = (GetTimestamp() - static_cast<int64_t>(cs)) / 1000.0; return; }
+        if (mg == MSG_FPS_ACK && len == 7) { streaming = true; cv.notify_all(); return; }
+        if (mg == MSG_HOST_INFO && len >= 16) { memcpy(&epochUs, d + 8, 8); return; }
+        if ((mg == MSG_HOST_INFO || mg == MSG_MONITOR_LIST) && len >= 6) return;
+        if (mg == MSG_AUDIO_DATA && len >= 16) return;
+        if (d[0] == Wire::VIDEO) HandleVideo(d, len, rt);
+    }
+
+    void SendAuth() {
+        std::vector<uint8_t> buf(6 + username.size() + pin.size());
+        uint32_t magic = MSG_AUTH_REQUEST;
+        memcpy(buf.data(), &magic, 4);
+        buf[4] = static_cast<uint8_t>(username.size()); buf[5] = static_cast<uint8_t>(pin.size());
+        memcpy(buf.data() + 6, username.data(), username.size());
+        memcpy(buf.data() + 6 + username.size(), pin.data(), pin.size());
+        SendMsg(buf.data(), buf.size());
+    }
+
+    // Ping every PING_MS and a NET_REPORT every REPORT_MS, as the browser's two intervals do
+    void TimerLoop() {
+        for (int tick = 1; running; tick++) {
+            std::this_thread::sleep_for(milliseconds(PING_MS));
+            std::lock_guard<std::mutex> lock(mutex);
+            uint8_t ping[16]; uint32_t magic = MSG_PING, r = static_cast<uint32_t>(rtt * 1000); uint64_t now = static_cast<uint64_t>(GetTimestamp());
+            memcpy(ping, &magic, 4); memcpy(ping + 4, &r, 4); memcpy(ping + 8, &now, 8);
+            SendBuf(ping);
+            if (!streaming || tick % (REPORT_MS / PING_MS)) continue;
+            uint32_t v[5] = {MSG_NET_REPORT, static_cast<uint32_t>(stats.complete - reportRef.complete), static_cast<uint32_t>(stats.dropped - reportRef.dropped),
+                             static_cast<uint32_t>((stats.chunks - reportRef.chunks) - (stats.chunksLost - reportRef.chunksLost)), static_cast<uint32_t>(stats.chunksLost - reportRef.chunksLost)};
+            if (SendMsg(v, sizeof(v))) { reportRef.complete = stats.complete; reportRef.dropped = stats.dropped; reportRef.chunks = stats.chunks; reportRef.chunksLost = stats.chunksLost; }
+        }
+    }
+
+public:
+    // up applies to what this client sends; the bandwidth cap is a downstream concern and is ignored here
+    LoopbackClient(const std::string& user, const std::string& p, int frameRate, LinkProfile up = {}) : username(user), pin(p), fps(frameRate) {
+        up.bandwidthBps = 0;
+        if (up.IsActive()) upstream = std::make_unique<LinkImpairment>(up);
+        peerConnection = std::make_shared<rtc::PeerConnection>(rtc::Configuration{});
+        peerConnection->onGatheringStateChange([this](auto state) {
+            if (state == rtc::PeerConnection::GatheringState::Complete) { std::lock_guard<std::mutex> lock(mutex); gathered = true; cv.notify_all(); }
+        });
+
+        rtc::DataChannelInit init;
+        init.reliability.unordered = true;
+        init.reliability.maxRetransmits = 0;
+        dataChannel = peerConnection->createDataChannel("screen", init);
+        if (upstream) upstream->Attach(dataChannel);
+        dataChannel->onOpen([this] { SendAuth(); });
+        dataChannel->onMessage([this](auto data) { if (auto* b = std::get_if<rtc::binary>(&data)) HandleMessage(*b); });
+        timer = std::thread([this] { TimerLoop(); });
+    }
+
+    ~LoopbackClient() {
+        running = false;
+        if (timer.joinable()) timer.join();
+        upstream.reset();
+        try { dataChannel->resetCallbacks(); dataChannel->close(); } catch (...) {}
+        try { peerConnection->resetCallbacks(); peerConnection->close(); } catch (...) {}
+    }
+
+    LoopbackClient(const LoopbackClient&) = delete;
+    LoopbackClient& operator=(const LoopbackClient&) = delete;
+
+    // Offer with every loopback candidate inline, since there is no trickle channel
+    std::string Offer() {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait_for(lock, 2s, [this] { return gathered; });
+        auto desc = peerConnection->localDescription();
+        return desc ? std::string(*desc) : std::string();
+    }
+
+    void Accept(const std::string& answer) { peerConnection->setRemoteDescription(rtc::Description(answer, "answer")); }
+
+    // True once the host acknowledged the frame rate, i.e. the session is streaming
+    bool WaitStreaming(milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(mutex);
+        return cv.wait_for(lock, timeout, [this] { return streaming || authFailed; }) && streaming;
+    }
+
+    Stats GetStats() { std::lock_guard<std::mutex> lock(mutex); return stats; }
+};
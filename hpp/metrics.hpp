@@ -0,0 +1,81 @@
+/**
+ * @file metrics.hpp
+ * @brief Monotonic counter helpers, latency histograms and Prometheus text exposition
+ * @copyright 2025-2026 Daniel Chrobak
+ */
+
+#pragma once
+#include "common.hpp"
+
+// Counters stay monotonic so any number of readers can observe them; each reader keeps its own baseline.
+// A total smaller than the baseline means the owner was recreated, so the whole total is new.
+struct CounterDelta {
+    uint64_t last = 0;
+    uint64_t operator()(uint64_t total) { uint64_t d = total >= last ? total - last : total; last = total; return d; }
+};
+
+class LatencyHistogram {
+public:
+    static constexpr int BUCKETS = 12;
+    static constexpr int64_t BOUNDS_US[BUCKETS] = {250, 500, 1000, 2000, 4000, 8000, 12000, 16000, 24000, 33000, 66000, 133000};
+
+private:
+    std::atomic<uint64_t> counts[BUCKETS + 1] = {}, sumUs{0};
+
+public:
+    void Observe(int64_t us) {
+        if (us < 0) return;
+        int b = static_cast<int>(std::lower_bound(BOUNDS_US, BOUNDS_US + BUCKETS, us) - BOUNDS_US);
+        counts[b].fetch_add(1, std::memory_order_relaxed);
+        sumUs.fetch_add(static_cast<uint64_t>(us), std::memory_order_relaxed);
+    }
+
+    friend class MetricsWriter;
+};
+
+// Histograms shared by the pipeline stages that feed them
+inline LatencyHistogram g_encodeLatency, g_sendLatency, g_gpuWaitLatency;
+
+class MetricsWriter {
+private:
+    std::string out;
+
+    void Header(const char* name, const char* help, const char* type) {
+        out += "# HELP "; out += name; out += ' '; out += help; out += "\n# TYPE "; out += name; out += ' '; out += type; out += '\n';
+    }
+
+public:
+    void Counter(const char* name, const char* help, uint64_t value) {
+        Header(name, help, "counter");
+        out += name; out += ' '; out += std::to_string(value); out += '\n';
+    }
+
+    // One family with a single label, e.g. input events by type
+    void Counter(const char* name, const char* help, const char* label, std::initializer_list<std::pair<const char*, uint64_t>> values) {
+        Header(name, help, "counter");
+        for (const auto& [l, v] : values) { out += name; out += '{'; out += label; out += "=\""; out += l; out += "\"} "; out += std::to_string(v); out += '\n'; }
+    }
+
+    void Gauge(const char* name, const char* help, double value) {
+        Header(name, help, "gauge");
+        char buf[32]; snprintf(buf, sizeof(buf), "%.17g", value);
+        out += name; out += ' '; out += buf; out += '\n';
+    }
+
+    // Exposed in seconds as Prometheus expects; buckets are cumulative
+    void Histogram(const char* name, const char* help, const LatencyHistogram& h) {
+        Header(name, help, "histogram");
+        uint64_t cum = 0;
+        char buf[128];
+        for (int i = 0; i < LatencyHistogram::BUCKETS; i++) {
+            cum += h.counts[i].load(std::memory_order_relaxed);
+            snprintf(buf, sizeof(buf), "%s_bucket{le=\"%g\"} %llu\n", name, LatencyHistogram::BOUNDS_US[i] / 1e6, cum);
+            out += buf;
+        }
+        cum += h.counts[LatencyHistogram::BUCKETS].load(std::memory_order_relaxed);
+        snprintf(buf, sizeof(buf), "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %.6f\n%s_count %llu\n", name, cum, name, h.sumUs.load() / 1e6, name, cum);
+        out += buf;
+    }
+
+    const std::string& Text() const { return out; }
+};
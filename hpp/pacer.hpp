@@ -0,0 +1,76 @@
+/**
+ * @file pacer.hpp
+ * @brief Token bucket that spreads a session's video chunks over time instead of bursting whole frames
+ * @copyright 2025-2026 Daniel Chrobak
+ */
+
+#pragma once
+#include "common.hpp"
+
+// Every message sent is charged, but only video waits for the bucket, so audio, acks and pongs jump ahead of a
+// frame that is still going out. The bucket may run into debt; a waiter sleeps until it is paid back.
+class Pacer {
+public:
+    static constexpr double PACING_FACTOR = 2.5;
+
+private:
+    static constexpr int64_t BURST_US = 2000, MIN_BURST_BYTES = 2800, MIN_RATE = 125000;
+
+    std::mutex mutex;
+    double tokens = 0;
+    int64_t rate = MIN_RATE, lastRefill = 0;  // bytes per second
+    HANDLE timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    HANDLE stopEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+
+    // Credit left over from an idle spell is capped, so the first frame after it still goes out paced
+    void Refill(int64_t now) {
+        if (lastRefill) tokens = std::min(tokens + (now - lastRefill) * rate / 1e6, std::max<double>(rate * BURST_US / 1e6, MIN_BURST_BYTES));
+        lastRefill = now;
+    }
+
+public:
+    Pacer() { if (!timer) timer = CreateWaitableTimerW(nullptr, FALSE, nullptr); }
+    ~Pacer() { if (timer) CloseHandle(timer); if (stopEvent) CloseHandle(stopEvent); }
+
+    Pacer(const Pacer&) = delete;
+    Pacer& operator=(const Pacer&) = delete;
+
+    // Paces at a multiple of the encoder target so an average frame is out well within its interval
+    void SetTargetBitrate(int64_t bps) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Refill(GetTimestamp());
+        rate = std::max(MIN_RATE, static_cast<int64_t>(bps * PACING_FACTOR / 8));
+    }
+
+    void Charge(size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Refill(GetTimestamp());
+        tokens -= static_cast<double>(bytes);
+    }
+
+    // Blocks until the bucket is out of debt; false once Stop() was called
+    bool Wait() {
+        while (true) {
+            int64_t waitUs;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                Refill(GetTimestamp());
+                if (tokens >= 0) return WaitForSingleObject(stopEvent, 0) != WAIT_OBJECT_0;
+                waitUs = static_cast<int64_t>(-tokens * 1e6 / rate) + 1;
+            }
+            LARGE_INTEGER due; due.QuadPart = -waitUs * 10;
+            HANDLE handles[2] = {stopEvent, timer};
+            if (!timer || !SetWaitableTimer(timer, &due, 0, nullptr, nullptr, FALSE)) { if (WaitForSingleObject(stopEvent, 1) == WAIT_OBJECT_0) return false; continue; }
+            if (WaitForMultipleObjects(2, handles, FALSE, INFINITE) == WAIT_OBJECT_0) return false;
+        }
+    }
+
+    // How long the current debt plus `bytes` more takes to go out at the pacing rate
+    int64_t DrainUs(size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Refill(GetTimestamp());
+        return static_cast<int64_t>((std::max(0.0, -tokens) + bytes) * 1e6 / rate);
+    }
+
+    void Stop() { SetEvent(stopEvent); }
+};
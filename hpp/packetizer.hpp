@@ -0,0 +1,92 @@
+/**
+ * @file packetizer.hpp
+ * @brief Splits encoded frames into DataChannel-sized chunks with optional XOR parity
+ * @copyright 2025-2026 Daniel Chrobak
+ */
+
+#pragma once
+#include "common.hpp"
+#include "encoder.hpp"
+#include "protocol.hpp"
+
+// In each PacketHeader, fecGroup is the number of data chunks per XOR parity chunk (0 = no FEC); parity chunks set
+// FRAME_FEC and carry their group index in chunkIndex. stream is the monitor index, so a viewer can tell frames of the
+// monitor it just left from the one it switched to.
+
+class Packetizer {
+public:
+    static constexpr size_t CHUNK_SIZE = 1400, FEC_LEN_SIZE = 2;
+    static constexpr uint8_t FRAME_KEY = 0x01, FRAME_RTX = 0x40, FRAME_FEC = 0x80;
+
+    // Only packets the sink accepted are counted
+    struct Result { size_t chunks = 0, parity = 0, bytes = 0, total = 0; };
+
+private:
+    std::vector<uint8_t> parityBuffer;
+
+    static void XorInto(uint8_t* dst, const uint8_t* src, size_t len) {
+        size_t i = 0;
+        for (; i + 8 <= len; i += 8) {
+            uint64_t a, b; memcpy(&a, dst + i, 8); memcpy(&b, src + i, 8);
+            a ^= b; memcpy(dst + i, &a, 8);
+        }
+        for (; i < len; i++) dst[i] ^= src[i];
+    }
+
+public:
+    Packetizer() : parityBuffer(CHUNK_SIZE) {}
+
+    // Each packet is written once, at its exact size, into a message emit(rtc::binary&, isParity) may move straight
+    // into DataChannel::send. emit returns whether the packet went out; a refused data chunk abandons the rest of
+    // the frame, a refused parity chunk is only skipped. Timestamps go out relative to the viewer's epochUs.
+    template<typename Emit>
+    Result Packetize(const EncodedFrame& frame, uint32_t frameId, size_t group, int64_t epochUs, Emit&& emit) {
+        Result r;
+        size_t dataSize = frame.data.size();
+        if (!dataSize) return r;
+        group = std::min<size_t>(group, 255);
+
+        // Sized for the longest header of the frame, found from a count that can only shrink once the real size is known
+        PacketHeader hdr;
+        hdr.timestamp = frame.ts; hdr.encodeTimeUs = static_cast<uint32_t>(frame.encUs); hdr.frameId = frameId;
+        hdr.frameType = frame.isKey ? FRAME_KEY : uint8_t(0); hdr.fecGroup = static_cast<uint8_t>(group); hdr.stream = frame.stream;
+        size_t bound = (dataSize + CHUNK_SIZE - PacketHeader::MAX_SIZE - FEC_LEN_SIZE - 1) / (CHUNK_SIZE - PacketHeader::MAX_SIZE - FEC_LEN_SIZE);
+        hdr.chunkIndex = hdr.totalChunks = static_cast<uint16_t>(std::min<size_t>(bound, 65535));
+        size_t chunkData = CHUNK_SIZE - hdr.Size(epochUs) - FEC_LEN_SIZE, numChunks = (dataSize + chunkData - 1) / chunkData;
+        if (numChunks > 65535) return r;
+        hdr.totalChunks = static_cast<uint16_t>(numChunks);
+        r.total = numChunks;
+
+        size_t parityLen = 0;
+        uint8_t* parity = parityBuffer.data();
+
+        for (size_t i = 0; i < numChunks; i++) {
+            hdr.chunkIndex = static_cast<uint16_t>(i);
+            size_t off = i * chunkData, len = std::min(chunkData, dataSize - off), hlen = hdr.Size(epochUs);
+            rtc::binary pkt(hlen + len);
+            auto* p = reinterpret_cast<uint8_t*>(pkt.data());
+            hdr.Write(p, epochUs);
+            memcpy(p + hlen, frame.data.data() + off, len);
+            if (!emit(pkt, false)) break;
+            r.chunks++; r.bytes += hlen + len;
+            if (!group) continue;
+
+            // Parity payload: XOR of the group's chunk lengths, then XOR of their data zero-padded to the longest
+            if (i % group == 0) { memset(parity, 0, FEC_LEN_SIZE + chunkData); parityLen = 0; }
+            *reinterpret_cast<uint16_t*>(parity) ^= static_cast<uint16_t>(len);
+            XorInto(parity + FEC_LEN_SIZE, frame.data.data() + off, len);
+            parityLen = std::max(parityLen, len);
+
+            if ((i + 1) % group == 0 || i + 1 == numChunks) {
+                PacketHeader ph = hdr;
+                ph.chunkIndex = static_cast<uint16_t>(i / group); ph.frameType |= FRAME_FEC;
+                size_t plen = ph.Size(epochUs), total = plen + FEC_LEN_SIZE + parityLen;
+                rtc::binary par(total);
+                ph.Write(reinterpret_cast<uint8_t*>(par.data()), epochUs);
+                memcpy(par.data() + plen, parity, FEC_LEN_SIZE + parityLen);
+                if (emit(par, true)) { r.parity++; r.bytes += total; }
+            }
+        }
+        return r;
+    }
+};
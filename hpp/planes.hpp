@@ -0,0 +1,165 @@
+/**
+ * @file planes.hpp
+ * @brief Vectorized NV12/P010 to planar 4:2:0 conversion for the software encoder path
+ * @copyright 2025-2026 Daniel Chrobak
+ */
+
+#pragma once
+#include "common.hpp"
+#include <intrin.h>
+#include <immintrin.h>
+
+class RowWorkers {
+private:
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    const std::function<void(int, int)>* job = nullptr;
+    int rows = 0, parts = 0, next = 0, remaining = 0;
+    uint64_t generation = 0;
+    bool stop = false;
+
+    void Work(std::unique_lock<std::mutex>& lock) {
+        while (next < parts) {
+            int p = next++;
+            lock.unlock();
+            (*job)(p * rows / parts, (p + 1) * rows / parts);
+            lock.lock();
+            if (--remaining == 0) done.notify_all();
+        }
+    }
+
+public:
+    explicit RowWorkers(int count) {
+        for (int i = 0; i < count; i++)
+            threads.emplace_back([this] {
+                uint64_t seen = 0;
+                std::unique_lock<std::mutex> lock(mutex);
+                while (true) {
+                    wake.wait(lock, [&] { return stop || generation != seen; });
+                    if (stop) return;
+                    seen = generation;
+                    Work(lock);
+                }
+            });
+    }
+
+    ~RowWorkers() {
+        { std::lock_guard<std::mutex> lock(mutex); stop = true; }
+        wake.notify_all();
+        for (auto& t : threads) t.join();
+    }
+
+    // Splits [0, count) into contiguous bands; the calling thread takes a band too and returns when all are done
+    void Run(int count, const std::function<void(int, int)>& fn) {
+        if (threads.empty() || count < 64) { fn(0, count); return; }
+        std::unique_lock<std::mutex> lock(mutex);
+        job = &fn; rows = count; parts = static_cast<int>(threads.size()) + 1; next = 0; remaining = parts;
+        generation++;
+        wake.notify_all();
+        Work(lock);
+        done.wait(lock, [&] { return remaining == 0; });
+    }
+
+    int GetCount() const { return static_cast<int>(threads.size()); }
+};
+
+class PlaneCopy {
+public:
+    enum class Isa { Scalar, SSE41, AVX2 };
+
+private:
+    static Isa Detect() {
+        int r[4];
+        __cpuid(r, 0);
+        if (r[0] < 1) return Isa::Scalar;
+        __cpuid(r, 1);
+        bool sse41 = r[2] & (1 << 19), osxsave = r[2] & (1 << 27), avx = r[2] & (1 << 28);
+        if (r[0] >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6) {
+            int e[4]; __cpuidex(e, 7, 0);
+            if (e[1] & (1 << 5)) return Isa::AVX2;
+        }
+        return sse41 ? Isa::SSE41 : Isa::Scalar;
+    }
+
+    static inline const Isa isa = Detect();
+
+    static void SplitUV8(const uint8_t* s, uint8_t* u, uint8_t* v, int n) {
+        int x = 0;
+        if (isa == Isa::AVX2) {
+            const __m256i mask = _mm256_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15,
+                                                  0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+            for (; x + 32 <= n; x += 32) {
+                __m256i a = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + 2 * x)), mask);
+                __m256i b = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + 2 * x + 32)), mask);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(u + x), _mm256_permute4x64_epi64(_mm256_unpacklo_epi64(a, b), _MM_SHUFFLE(3, 1, 2, 0)));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(v + x), _mm256_permute4x64_epi64(_mm256_unpackhi_epi64(a, b), _MM_SHUFFLE(3, 1, 2, 0)));
+            }
+        }
+        if (isa != Isa::Scalar) {
+            const __m128i mask = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+            for (; x + 16 <= n; x += 16) {
+                __m128i a = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 2 * x)), mask);
+                __m128i b = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 2 * x + 16)), mask);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(u + x), _mm_unpacklo_epi64(a, b));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(v + x), _mm_unpackhi_epi64(a, b));
+            }
+        }
+        for (; x < n; x++) { u[x] = s[2 * x]; v[x] = s[2 * x + 1]; }
+    }
+
+    // P010 keeps samples in the high 10 bits, yuv420p10 in the low ones
+    static void Shift16(const uint16_t* s, uint16_t* d, int n) {
+        int x = 0;
+        if (isa == Isa::AVX2)
+            for (; x + 16 <= n; x += 16)
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(d + x), _mm256_srli_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + x)), 6));
+        if (isa != Isa::Scalar)
+            for (; x + 8 <= n; x += 8)
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(d + x), _mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + x)), 6));
+        for (; x < n; x++) d[x] = s[x] >> 6;
+    }
+
+    static void SplitUV16(const uint16_t* s, uint16_t* u, uint16_t* v, int n) {
+        int x = 0;
+        if (isa == Isa::AVX2) {
+            const __m256i lo = _mm256_set1_epi32(0xFFFF);
+            for (; x + 16 <= n; x += 16) {
+                __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + 2 * x));
+                __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + 2 * x + 16));
+                __m256i uu = _mm256_packus_epi32(_mm256_and_si256(a, lo), _mm256_and_si256(b, lo));
+                __m256i vv = _mm256_packus_epi32(_mm256_srli_epi32(a, 16), _mm256_srli_epi32(b, 16));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(u + x), _mm256_srli_epi16(_mm256_permute4x64_epi64(uu, _MM_SHUFFLE(3, 1, 2, 0)), 6));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(v + x), _mm256_srli_epi16(_mm256_permute4x64_epi64(vv, _MM_SHUFFLE(3, 1, 2, 0)), 6));
+            }
+        }
+        if (isa != Isa::Scalar) {
+            const __m128i lo = _mm_set1_epi32(0xFFFF);
+            for (; x + 8 <= n; x += 8) {
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 2 * x));
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 2 * x + 8));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(u + x), _mm_srli_epi16(_mm_packus_epi32(_mm_and_si128(a, lo), _mm_and_si128(b, lo)), 6));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(v + x), _mm_srli_epi16(_mm_packus_epi32(_mm_srli_epi32(a, 16), _mm_srli_epi32(b, 16)), 6));
+            }
+        }
+        for (; x < n; x++) { u[x] = s[2 * x] >> 6; v[x] = s[2 * x + 1] >> 6; }
+    }
+
+public:
+    static Isa GetIsa() { return isa; }
+    static const char* GetIsaName() { return isa == Isa::AVX2 ? "AVX2" : isa == Isa::SSE41 ? "SSE4.1" : "Scalar"; }
+
+    // Converts chroma rows [begin, end) and the luma row pairs above them from a mapped NV12/P010 surface into dst
+    static void Convert(const uint8_t* src, UINT pitch, UINT rows, AVFrame* dst, int w, bool wide, int begin, int end) {
+        const uint8_t* uv = src + static_cast<size_t>(pitch) * rows;
+        for (int y = begin * 2; y < end * 2; y++) {
+            if (wide) Shift16(reinterpret_cast<const uint16_t*>(src + y * pitch), reinterpret_cast<uint16_t*>(dst->data[0] + y * dst->linesize[0]), w);
+            else memcpy(dst->data[0] + y * dst->linesize[0], src + y * pitch, w);
+        }
+        for (int y = begin; y < end; y++) {
+            if (wide) SplitUV16(reinterpret_cast<const uint16_t*>(uv + y * pitch), reinterpret_cast<uint16_t*>(dst->data[1] + y * dst->linesize[1]),
+                                reinterpret_cast<uint16_t*>(dst->data[2] + y * dst->linesize[2]), w / 2);
+            else SplitUV8(uv + y * pitch, dst->data[1] + y * dst->linesize[1], dst->data[2] + y * dst->linesize[2], w / 2);
+        }
+    }
+};
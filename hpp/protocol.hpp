@@ -0,0 +1,117 @@
+/**
+ * @file protocol.hpp
+ * @brief Compact wire framing (typed records, varints, video chunk header) and the magic dispatch table
+ * @copyright 2025-2026 Daniel Chrobak
+ */
+
+#pragma once
+#include "common.hpp"
+#include <array>
+
+// Control messages still lead with a 4-byte ASCII magic, so a first byte below COMPACT_LIMIT marks a compact record
+// instead. Only the hot paths use them: video chunks, and batches of small messages sent in one go.
+struct Wire {
+    static constexpr uint8_t VERSION = 1, COMPACT_LIMIT = 0x20;
+    enum Type : uint8_t { VIDEO = 0x01, BATCH = 0x02 };
+    static constexpr size_t MAX_VARINT = 10;
+
+    static bool IsCompact(const uint8_t* d, size_t len) { return len && d[0] < COMPACT_LIMIT; }
+
+    static constexpr size_t VarintSize(uint64_t v) { size_t n = 1; while (v >= 0x80) { v >>= 7; n++; } return n; }
+    static uint8_t* PutVarint(uint8_t* p, uint64_t v) { while (v >= 0x80) { *p++ = static_cast<uint8_t>(v) | 0x80; v >>= 7; } *p++ = static_cast<uint8_t>(v); return p; }
+    // nullptr on a truncated or over-long varint
+    static const uint8_t* GetVarint(const uint8_t* p, const uint8_t* end, uint64_t& v) {
+        v = 0;
+        for (int shift = 0; p < end && shift < 64; shift += 7) {
+            uint8_t b = *p++;
+            v |= static_cast<uint64_t>(b & 0x7F) << shift;
+            if (!(b & 0x80)) return p;
+        }
+        return nullptr;
+    }
+    static constexpr uint64_t ZigZag(int64_t v) { return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63); }
+    static constexpr int64_t UnZigZag(uint64_t v) { return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1); }
+
+    // Calls fn(data, len) for every message in a BATCH record; false if the record is malformed
+    template<typename Fn>
+    static bool ForEachInBatch(const uint8_t* d, size_t len, Fn&& fn) {
+        const uint8_t *p = d + 1, *end = d + len;
+        while (p < end) {
+            uint64_t n;
+            if (!(p = GetVarint(p, end, n)) || n > static_cast<uint64_t>(end - p)) return false;
+            fn(p, static_cast<size_t>(n));
+            p += n;
+        }
+        return true;
+    }
+};
+
+// Video chunk header. On the wire: type, frameType, stream, fecGroup as single bytes, then varint frameId,
+// chunkIndex and totalChunks, zigzag varint of timestamp minus the session epoch (sent in HOST_INFO) and varint
+// encodeTimeUs; 15-17 bytes in practice instead of 23. The first four bytes are fixed so a retransmit can flag its copy.
+struct PacketHeader {
+    static constexpr size_t FRAME_TYPE_OFFSET = 1, MAX_SIZE = 4 + 5 + 3 + 3 + Wire::MAX_VARINT + 5;
+
+    int64_t timestamp = 0;
+    uint32_t encodeTimeUs = 0, frameId = 0;
+    uint16_t chunkIndex = 0, totalChunks = 0;
+    uint8_t frameType = 0, fecGroup = 0, stream = 0;
+
+    size_t Size(int64_t epochUs) const {
+        return 4 + Wire::VarintSize(frameId) + Wire::VarintSize(chunkIndex) + Wire::VarintSize(totalChunks) +
+               Wire::VarintSize(Wire::ZigZag(timestamp - epochUs)) + Wire::VarintSize(encodeTimeUs);
+    }
+
+    uint8_t* Write(uint8_t* p, int64_t epochUs) const {
+        *p++ = Wire::VIDEO; *p++ = frameType; *p++ = stream; *p++ = fecGroup;
+        p = Wire::PutVarint(p, frameId); p = Wire::PutVarint(p, chunkIndex); p = Wire::PutVarint(p, totalChunks);
+        p = Wire::PutVarint(p, Wire::ZigZag(timestamp - epochUs));
+        return Wire::PutVarint(p, encodeTimeUs);
+    }
+
+    // Header length, or 0 if this is not a well-formed video chunk
+    size_t Read(const uint8_t* d, size_t len, int64_t epochUs) {
+        if (len < 4 || d[0] != Wire::VIDEO) return 0;
+        frameType = d[1]; stream = d[2]; fecGroup = d[3];
+        const uint8_t *p = d + 4, *end = d + len;
+        uint64_t v[5];
+        for (auto& x : v) if (!(p = Wire::GetVarint(p, end, x))) return 0;
+        if (v[0] > UINT32_MAX || v[1] > UINT16_MAX || v[2] > UINT16_MAX || v[4] > UINT32_MAX) return 0;
+        frameId = static_cast<uint32_t>(v[0]); chunkIndex = static_cast<uint16_t>(v[1]); totalChunks = static_cast<uint16_t>(v[2]);
+        timestamp = epochUs + Wire::UnZigZag(v[3]); encodeTimeUs = static_cast<uint32_t>(v[4]);
+        return static_cast<size_t>(p - d);
+    }
+};
+
+// Maps a message magic to a member handler through a table sorted at compile time, instead of a chain of compares
+template<typename Owner>
+struct Route {
+    enum : uint8_t { EXACT = 1, CONTROL = 2, UNAUTHENTICATED = 4 };
+    uint32_t magic;
+    uint16_t minSize;
+    uint8_t flags;
+    void (Owner::*handler)(const uint8_t*, size_t);
+};
+
+template<typename Owner, size_t N>
+class RouteTable {
+private:
+    std::array<Route<Owner>, N> routes{};
+
+public:
+    constexpr explicit RouteTable(const Route<Owner> (&r)[N]) {
+        for (size_t i = 0; i < N; i++) routes[i] = r[i];
+        std::sort(routes.begin(), routes.end(), [](const auto& a, const auto& b) { return a.magic < b.magic; });
+        for (size_t i = 1; i < N; i++) if (routes[i].magic == routes[i - 1].magic) throw "duplicate route";
+    }
+
+    // The route if magic is known and len satisfies its size rule
+    constexpr const Route<Owner>* Find(uint32_t magic, size_t len) const {
+        auto it = std::lower_bound(routes.begin(), routes.end(), magic, [](const auto& r, uint32_t m) { return r.magic < m; });
+        if (it == routes.end() || it->magic != magic) return nullptr;
+        return ((it->flags & Route<Owner>::EXACT) ? len == it->minSize : len >= it->minSize) ? &*it : nullptr;
+    }
+};
+
+template<typename Owner, size_t N>
+constexpr RouteTable<Owner, N> MakeRoutes(const Route<Owner> (&r)[N]) { return RouteTable<Owner, N>(r); }
@@ -0,0 +1,90 @@
+/**
+ * @file rtp.hpp
+ * @brief Media track transport: AV1 and Opus over RTP instead of DataChannel chunks
+ * @copyright 2025-2026 Daniel Chrobak
+ */
+
+#pragma once
+#include "common.hpp"
+#include "encoder.hpp"
+
+// Answers a viewer's recvonly AV1 and Opus sections with sendonly tracks. The viewer's own WebRTC stack then does
+// depacketization, jitter buffering and decode; the host keeps a short RTP history for NACKs and turns PLIs into
+// keyframe requests. Timestamps are derived from capture time, so RTP and DataChannel runs stay comparable.
+class RtpMedia {
+private:
+    static constexpr uint32_t VIDEO_CLOCK = 90000, AUDIO_CLOCK = 48000, VIDEO_SSRC = 0x53530001, AUDIO_SSRC = 0x53530002;
+    static constexpr size_t MAX_FRAGMENT = 1200;
+
+    std::shared_ptr<rtc::Track> video, audio;
+    std::shared_ptr<rtc::RtpPacketizationConfig> videoConfig, audioConfig;
+    int64_t originUs = 0;
+
+    // Payload type the offer uses for a codec, or -1
+    static int FindPayloadType(const rtc::Description::Media& m, const char* format) {
+        for (int pt : m.payloadTypes())
+            if (auto* map = m.rtpMap(pt); map && _stricmp(map->format.c_str(), format) == 0) return pt;
+        return -1;
+    }
+
+public:
+    // False unless the offer asked for AV1 video; Opus audio is optional. Called before the offer is applied so
+    // libdatachannel answers those sections with these tracks.
+    bool Attach(rtc::PeerConnection& pc, const rtc::Description& offer, std::function<void()> onKeyRequest) {
+        for (int i = 0; i < offer.mediaCount(); i++) {
+            auto entry = offer.media(i);
+            auto* m = std::get_if<const rtc::Description::Media*>(&entry);
+            if (!m) continue;
+            const auto& media = **m;
+            if (media.type() == "video" && !video) {
+                int pt = FindPayloadType(media, "AV1");
+                if (pt < 0) continue;
+                rtc::Description::Video desc(media.mid(), rtc::Description::Direction::SendOnly);
+                desc.addAV1Codec(pt);
+                desc.addSSRC(VIDEO_SSRC, "slipstream-video", "slipstream", "video");
+                video = pc.addTrack(desc);
+                videoConfig = std::make_shared<rtc::RtpPacketizationConfig>(VIDEO_SSRC, "slipstream-video", static_cast<uint8_t>(pt), VIDEO_CLOCK);
+                auto packetizer = std::make_shared<rtc::AV1RtpPacketizer>(rtc::AV1RtpPacketizer::Packetization::TemporalUnit, videoConfig, MAX_FRAGMENT);
+                packetizer->addToChain(std::make_shared<rtc::RtcpSrReporter>(videoConfig));
+                packetizer->addToChain(std::make_shared<rtc::RtcpNackResponder>());
+                packetizer->addToChain(std::make_shared<rtc::PliHandler>(onKeyRequest));
+                video->setMediaHandler(packetizer);
+            } else if (media.type() == "audio" && !audio) {
+                int pt = FindPayloadType(media, "opus");
+                if (pt < 0) continue;
+                rtc::Description::Audio desc(media.mid(), rtc::Description::Direction::SendOnly);
+                desc.addOpusCodec(pt);
+                desc.addSSRC(AUDIO_SSRC, "slipstream-audio", "slipstream", "audio");
+                audio = pc.addTrack(desc);
+                audioConfig = std::make_shared<rtc::RtpPacketizationConfig>(AUDIO_SSRC, "slipstream-audio", static_cast<uint8_t>(pt), AUDIO_CLOCK);
+                auto packetizer = std::make_shared<rtc::OpusRtpPacketizer>(audioConfig);
+                packetizer->addToChain(std::make_shared<rtc::RtcpSrReporter>(audioConfig));
+                audio->setMediaHandler(packetizer);
+            }
+        }
+        if (!video) { audio.reset(); return false; }
+        originUs = GetTimestamp();
+        return true;
+    }
+
+    bool IsVideoOpen() const { return video && video->isOpen(); }
+    bool IsAudioOpen() const { return audio && audio->isOpen(); }
+
+    // One temporal unit of OBUs per call, exactly as the encoder produced it. Video only comes from the session's
+    // sender thread and audio only from audioThread, so the two configs need no lock.
+    bool SendVideo(const EncodedFrame& frame) {
+        if (!IsVideoOpen()) return false;
+        videoConfig->timestamp = videoConfig->startTimestamp + static_cast<uint32_t>((frame.ts - originUs) * VIDEO_CLOCK / 1000000);
+        try { return video->send(reinterpret_cast<const std::byte*>(frame.data.data()), frame.data.size()); } catch (...) { return false; }
+    }
+
+    bool SendAudio(const uint8_t* data, size_t size, int64_t ts) {
+        if (!IsAudioOpen()) return false;
+        audioConfig->timestamp = audioConfig->startTimestamp + static_cast<uint32_t>((ts - originUs) * AUDIO_CLOCK / 1000000);
+        try { return audio->send(reinterpret_cast<const std::byte*>(data), size); } catch (...) { return false; }
+    }
+
+    void Close() {
+        for (auto* t : {&video, &audio}) try { if (*t) { (*t)->resetCallbacks(); (*t)->close(); } } catch (...) {}
+    }
+};
@@ -0,0 +1,670 @@
+/**
+ * @file session.hpp
+ * @brief Per-viewer WebRTC session: signaling, auth, packetization and its own send queue
+ * @copyright 2025-2026 Daniel Chrobak
+ */
+
+#pragma once
+#include "common.hpp"
+#include "encoder.hpp"
+#include "packetizer.hpp"
+#include "input.hpp"
+#include "congestion.hpp"
+#include "pacer.hpp"
+#include "cursor.hpp"
+#include "cadence.hpp"
+#include "impair.hpp"
+#include "rtp.hpp"
+#include "trace.hpp"
+#include "metrics.hpp"
+
+#pragma pack(push, 1)
+struct AudioPacketHeader { uint32_t magic; int64_t timestamp; uint16_t samples, dataLength; };
+// Client's pick for the shared Opus encoder: frame length in microseconds (2500, 5000, 10000 or 20000) and kbps
+struct AudioConfigMsg { uint32_t magic; uint16_t frameUs, kbps; uint8_t flags; };
+enum : uint8_t { AUDIO_FEC = 1, AUDIO_DTX = 2 };
+struct AuthRequestMsg { uint32_t magic; uint8_t usernameLength, pinLength; };
+struct AuthResponseMsg { uint32_t magic; uint8_t success, errorLength; };
+#pragma pack(pop)
+
+// One encoded frame shared by every session's queue; id is assigned once so all viewers see the same frame numbering
+struct OutgoingFrame { EncodedFrame frame; uint32_t id = 0; };
+
+// Frames return here once every session has sent them, so the next copy reuses their data capacity
+class OutgoingFramePool : public std::enable_shared_from_this<OutgoingFramePool> {
+    static constexpr size_t MAX_FREE = 8;
+    std::mutex mutex;
+    std::vector<std::unique_ptr<OutgoingFrame>> free;
+
+public:
+    std::shared_ptr<OutgoingFrame> Acquire() {
+        std::unique_ptr<OutgoingFrame> f;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!free.empty()) { f = std::move(free.back()); free.pop_back(); }
+        }
+        if (!f) f = std::make_unique<OutgoingFrame>();
+        std::weak_ptr<OutgoingFramePool> pool = weak_from_this();
+        return std::shared_ptr<OutgoingFrame>(f.release(), [pool](OutgoingFrame* p) {
+            std::unique_ptr<OutgoingFrame> owned(p);
+            if (auto self = pool.lock()) {
+                std::lock_guard<std::mutex> lock(self->mutex);
+                if (self->free.size() < MAX_FREE) self->free.push_back(std::move(owned));
+            }
+        });
+    }
+};
+
+// Owned by WebRTCServer and read by every session
+struct SessionShared {
+    std::string authUsername, authPin;
+    std::mutex authMutex;
+    InputHandler* inputHandler = nullptr;
+
+    std::function<void(int, uint8_t)> onFpsChange;
+    std::function<int()> getHostFps, getCurrentMonitor, getBitDepth;
+    std::function<bool(int)> onMonitorChange;
+    std::function<CursorTracker::Shape(uint32_t)> getCursorShape;
+    std::function<void(const AudioConfigMsg&)> onAudioConfig;
+    std::function<void()> onAuthenticated, onMonitorChanged, onSessionEnded;
+
+    // Only the controller may send input or change fps/monitor; 0 = nobody holds control
+    std::atomic<uint64_t> controllerId{0};
+    std::atomic<int> currentFps{60}, focusedStream{0};
+    std::atomic<uint8_t> currentFpsMode{0};
+    std::atomic<bool> intraRefresh{false};
+    FrameCadence cadence;  // Fed by the controller's present reports
+    LinkProfile link;  // Emulated downstream link for loopback benchmarks; set before the first offer
+    // dropCount is frames a session gave up on while sending; skipCount is frames never encoded because every viewer was congested
+    std::atomic<uint64_t> sentCount{0}, byteCount{0}, dropCount{0}, skipCount{0}, audioSentCount{0}, parityCount{0}, rtxCount{0}, lossReportCount{0};
+};
+
+class PeerSession {
+public:
+    static constexpr size_t BUFFER_THRESHOLD = 32768, HARD_BUFFER_LIMIT = BUFFER_THRESHOLD * 8;
+    static constexpr int64_t LOW_LAYER_DOWN_BPS = 6000000, LOW_LAYER_UP_BPS = 12000000;
+
+private:
+    static constexpr int64_t LAYER_HOLD_US = 5000000;
+    static constexpr size_t KEY_CACHE_FRAMES = 2, KEY_CACHE_BYTES = 8 << 20, MAX_NACK_CHUNKS = 512, MAX_QUEUE = 3;
+    static constexpr int LOSS_BURST = 5, MAX_DRAIN_FRAMES = 2;
+    static constexpr int64_t LOSS_WINDOW_US = 1000000, LOSS_KEY_INTERVAL_US = 250000, AUDIO_BATCH_US = 20000;
+    static constexpr size_t AUDIO_BATCH_BYTES = 1100;
+    // Each class only watches its own channel's backlog, so a video burst no longer silences audio or the cursor
+    static constexpr size_t AUDIO_BUFFER_LIMIT = 16384, INPUT_BUFFER_LIMIT = 4096;
+
+    // The viewer opens one channel per traffic class: video unreliable, control reliable and ordered, input ordered
+    // with a lifetime, audio unreliable. A class whose channel it did not open falls back to video.
+    enum Channel { VIDEO, CONTROL, INPUT, AUDIO, CHANNEL_COUNT };
+    static constexpr const char* CHANNEL_LABELS[CHANNEL_COUNT] = {"screen", "control", "input", "audio"};
+
+    const uint64_t id;
+    SessionShared& shared;
+    std::shared_ptr<rtc::PeerConnection> peerConnection;
+    std::shared_ptr<rtc::DataChannel> channels[CHANNEL_COUNT];
+    std::unique_ptr<LinkImpairment> impairment;
+
+    std::atomic<bool> connected{false}, needsKeyframe{true}, fpsReceived{false}, closed{false};
+    std::atomic<bool> gatheringComplete{false}, authenticated{false}, hasLocalDescription{false};
+    std::string localDescription;
+    std::mutex descMutex;
+    std::condition_variable descCondition;
+
+    // Data packets of recent keyframes exactly as sent, so NACKed chunks are resent instead of encoding a new keyframe
+    struct CachedFrame { uint32_t id = 0; std::vector<uint8_t> packets; std::vector<uint32_t> offsets; };
+    std::deque<CachedFrame> keyCache;
+    std::mutex cacheMutex;
+
+    // Frames wait here for this session's sender thread; a full queue drops deltas until the next keyframe
+    std::deque<std::shared_ptr<const OutgoingFrame>> queue;
+    rtc::binary audioBatch;
+    uint64_t audioBatched = 0;
+    int64_t audioBatchAt = 0;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    bool stopping = false, waitingKey = false;
+    std::thread sender;
+
+    // layer is the rung this viewer is receiving; wantedLayer differs while it waits for the other rung's keyframe
+    std::atomic<int> layer{0}, wantedLayer{0};
+    int stream = -1;  // Monitor of the frames this viewer is decoding; another monitor's deltas wait for its keyframe
+    int64_t lastLayerSwitch = 0;
+
+    Packetizer packetizer;
+    // Chunk timestamps go out relative to this, which HOST_INFO tells the viewer, to keep their varints short
+    const int64_t epochUs = GetTimestamp();
+    std::atomic<uint32_t> lastKeyId{0};
+    std::atomic<int> overflowCount{0}, authAttempts{0}, candidateCount{0};
+    std::atomic<int64_t> lastPingTime{0};
+    std::atomic<bool> pingTimeout{false};
+    std::atomic<const char*> kickReason{nullptr};
+    std::atomic<int64_t> closedAt{0};
+    int64_t lossWindowStart = 0, lastLossKeyUs = 0;
+    int lossInWindow = 0;
+    CongestionController congestion{BUFFER_THRESHOLD};
+    Pacer pacer;
+    // With media tracks negotiated, video and audio skip the packetizer; DataChannels still carry everything else
+    RtpMedia rtp;
+    bool rtpMode = false;
+
+    void CacheKeyframe(CachedFrame&& frame) {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        keyCache.push_back(std::move(frame));
+        size_t bytes = 0;
+        for (const auto& f : keyCache) bytes += f.packets.size();
+        while (keyCache.size() > KEY_CACHE_FRAMES || (keyCache.size() > 1 && bytes > KEY_CACHE_BYTES)) { bytes -= keyCache.front().packets.size(); keyCache.pop_front(); }
+    }
+
+    // NACK: magic, frameId u32, count u16, chunk indices u16[count]
+    void HandleNack(const uint8_t* data, size_t size) {
+        if (size < 10) return;
+        uint32_t fid = *reinterpret_cast<const uint32_t*>(data + 4);
+        size_t count = std::min<size_t>({*reinterpret_cast<const uint16_t*>(data + 8), (size - 10) / 2, MAX_NACK_CHUNKS});
+        auto* idx = reinterpret_cast<const uint16_t*>(data + 10);
+
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        auto it = std::find_if(keyCache.begin(), keyCache.end(), [fid](const CachedFrame& f) { return f.id == fid; });
+        if (it == keyCache.end()) { needsKeyframe = true; return; }
+        for (size_t i = 0; i < count; i++) {
+            if (idx[i] >= it->offsets.size()) continue;
+            size_t begin = it->offsets[idx[i]], end = idx[i] + 1u < it->offsets.size() ? it->offsets[idx[i] + 1] : it->packets.size();
+            rtc::binary pkt(end - begin);
+            memcpy(pkt.data(), it->packets.data() + begin, end - begin);
+            reinterpret_cast<uint8_t*>(pkt.data())[PacketHeader::FRAME_TYPE_OFFSET] |= Packetizer::FRAME_RTX;
+            if (SafeSend(std::move(pkt))) { shared.byteCount += end - begin; shared.rtxCount++; }
+        }
+    }
+
+    // FRAME_LOSS: magic, last decoded frameId u32, lost frameId u32. A keyframe sent after the loss already repairs it,
+    // as does one the viewer has yet to reach; with intra refresh the refresh wave does, unless losses arrive faster
+    // than it can sweep the picture. Without it one keyframe per LOSS_KEY_INTERVAL_US covers every loss before it.
+    void HandleFrameLoss(const uint8_t* data, size_t size) {
+        if (size < 12) return;
+        uint32_t lastGood = *reinterpret_cast<const uint32_t*>(data + 4), lost = *reinterpret_cast<const uint32_t*>(data + 8);
+        shared.lossReportCount++;
+        if (static_cast<int32_t>(lastKeyId - lost) > 0 || static_cast<int32_t>(lastKeyId - lastGood) > 0) return;
+        int64_t now = GetTimestamp();
+        if (now - lossWindowStart > LOSS_WINDOW_US) { lossWindowStart = now; lossInWindow = 0; }
+        if (++lossInWindow > LOSS_BURST || (!shared.intraRefresh && now - lastLossKeyUs >= LOSS_KEY_INTERVAL_US)) {
+            needsKeyframe = true; lossInWindow = 0; lastLossKeyUs = now;
+        }
+    }
+
+    // TRACE_REPORT: magic, count u16, then per frame capture ts, receive, decode and present i64 on this host's clock
+    void HandleTraceReport(const uint8_t* data, size_t size) {
+        if (size < 6 || !Trace::IsEnabled()) return;
+        size_t count = std::min<size_t>(*reinterpret_cast<const uint16_t*>(data + 4), (size - 6) / 32);
+        for (size_t i = 0; i < count; i++) {
+            int64_t v[4]; memcpy(v, data + 6 + i * 32, sizeof(v));
+            Trace::Record(Trace::ClientReceive, v[0], v[1]);
+            Trace::Record(Trace::ClientDecode, v[0], v[2]);
+            Trace::Record(Trace::ClientPresent, v[0], v[3]);
+        }
+    }
+
+    std::shared_ptr<rtc::DataChannel> Pick(Channel c) const {
+        auto ch = channels[c];
+        return ch && ch->isOpen() ? ch : channels[VIDEO];
+    }
+
+    // Every class is charged to the pacer, which paces the link they share; only video goes through an emulated link
+    bool SafeSend(const void* data, size_t len, Channel c = VIDEO) {
+        auto ch = Pick(c);
+        if (!ch || !ch->isOpen()) return false;
+        pacer.Charge(len);
+        if (impairment && ch == channels[VIDEO]) { impairment->Send(data, len); return true; }
+        try { ch->send(reinterpret_cast<const std::byte*>(data), len); return true; } catch (...) { return false; }
+    }
+
+    // Hands the message itself to libdatachannel, which takes it over without another copy
+    bool SafeSend(rtc::binary&& msg, Channel c = VIDEO) {
+        auto ch = Pick(c);
+        if (!ch || !ch->isOpen()) return false;
+        pacer.Charge(msg.size());
+        if (impairment && ch == channels[VIDEO]) { impairment->Send(std::move(msg)); return true; }
+        try { ch->send(std::move(msg)); return true; } catch (...) { return false; }
+    }
+
+    // What the transport still holds, including an emulated link's bottleneck queue
+    size_t Buffered(const std::shared_ptr<rtc::DataChannel>& ch) const { return ch->bufferedAmount() + (impairment && ch == channels[VIDEO] ? impairment->Backlog() : 0); }
+
+    void SendAuthResponse(bool success, const std::string& error = "") {
+        std::vector<uint8_t> buf(sizeof(AuthResponseMsg) + (success ? 0 : error.size()));
+        auto* msg = reinterpret_cast<AuthResponseMsg*>(buf.data());
+        msg->magic = MSG_AUTH_RESPONSE;
+        msg->success = success ? 1 : 0;
+        msg->errorLength = success ? 0 : static_cast<uint8_t>(std::min(error.size(), size_t(255)));
+        if (!success) memcpy(buf.data() + sizeof(AuthResponseMsg), error.c_str(), msg->errorLength);
+
+        SafeSend(buf.data(), buf.size(), CONTROL);
+
+        if (success) { LOG("Peer %llu authenticated%s", id, IsController() ? " (controller)" : " (viewer)"); authAttempts = 0; }
+        else {
+            int att = ++authAttempts;
+            WARN("Peer %llu auth failed (%d/3): %s", id, att, error.c_str());
+            // Closed from the sender thread so the response still goes out and the channel callback is not torn down from inside
+            if (att >= 3) kickReason = "Too many authentication failures";
+        }
+    }
+
+    void SendFpsAck(int fps, uint8_t mode) {
+        uint8_t ack[7]; *reinterpret_cast<uint32_t*>(ack) = MSG_FPS_ACK;
+        *reinterpret_cast<uint16_t*>(ack + 4) = static_cast<uint16_t>(fps); ack[6] = mode;
+        SafeSend(ack, sizeof(ack), CONTROL);
+    }
+
+    void OnAuthRequest(const uint8_t* data, size_t size) {
+        auto* m = reinterpret_cast<const AuthRequestMsg*>(data);
+        if (size < sizeof(AuthRequestMsg) + m->usernameLength + m->pinLength) return;
+        std::string user(reinterpret_cast<const char*>(data) + sizeof(AuthRequestMsg), m->usernameLength);
+        std::string pin(reinterpret_cast<const char*>(data) + sizeof(AuthRequestMsg) + m->usernameLength, m->pinLength);
+
+        bool ok;
+        { std::lock_guard<std::mutex> lock(shared.authMutex); ok = user == shared.authUsername && pin == shared.authPin; }
+        if (ok) {
+            authenticated = true;
+            uint64_t none = 0;
+            bool control = shared.controllerId.compare_exchange_strong(none, id) || shared.controllerId == id;
+            SendAuthResponse(true);
+            SendHostInfo();
+            SendMonitorList();
+            if (control && shared.onAuthenticated) shared.onAuthenticated();
+        } else SendAuthResponse(false, "Invalid credentials");
+    }
+
+    void OnInput(const uint8_t* data, size_t size) { if (shared.inputHandler) shared.inputHandler->HandleMessage(data, size); }
+
+    void OnPing(const uint8_t* data, size_t) {
+        lastPingTime = GetTimestamp() / 1000; overflowCount = 0; pingTimeout = false;
+        congestion.OnRtt(*reinterpret_cast<const uint32_t*>(data + 4), GetTimestamp());
+        uint8_t resp[24]; memcpy(resp, data, 16);
+        *reinterpret_cast<uint64_t*>(resp + 16) = GetTimestamp();
+        SafeSend(resp, sizeof(resp));
+    }
+
+    void OnFpsSet(const uint8_t* data, size_t) {
+        uint16_t fps = *reinterpret_cast<const uint16_t*>(data + 4);
+        uint8_t mode = data[6];
+        if (fps < 1 || fps > 240 || mode > 2) return;
+        // Viewers follow whatever rate the controller picked
+        if (IsController()) {
+            int actual = (mode == 1 && shared.getHostFps) ? shared.getHostFps() : fps;
+            shared.currentFps = actual; shared.currentFpsMode = mode;
+            if (shared.onFpsChange) shared.onFpsChange(actual, mode);
+        }
+        fpsReceived = true;
+        SendFpsAck(shared.currentFps, shared.currentFpsMode);
+    }
+
+    void OnRequestKey(const uint8_t*, size_t) { needsKeyframe = true; }
+
+    // A viewer that missed or never saw a shape asks for it by hash
+    void OnCursorRequest(const uint8_t* data, size_t) {
+        uint32_t hash = *reinterpret_cast<const uint32_t*>(data + 4);
+        if (auto shape = shared.getCursorShape ? shared.getCursorShape(hash) : nullptr) SafeSend(shape->data(), shape->size(), CONTROL);
+    }
+
+    void OnNetReport(const uint8_t* data, size_t size) {
+        auto* p = reinterpret_cast<const uint32_t*>(data + 4);
+        congestion.OnLossReport(p[0], p[1]);
+        if (size >= 20) congestion.OnChunkReport(p[2], p[3]);
+    }
+
+    void OnAudioConfig(const uint8_t* data, size_t) {
+        AudioConfigMsg cfg; memcpy(&cfg, data, sizeof(cfg));
+        if (shared.onAudioConfig) shared.onAudioConfig(cfg);
+    }
+
+    void OnPresentReport(const uint8_t* data, size_t) { PresentReportMsg r; memcpy(&r, data, sizeof(r)); shared.cadence.OnReport(r); }
+
+    void OnMonitorSet(const uint8_t* data, size_t) {
+        if (shared.onMonitorChange && shared.onMonitorChange(data[4]) && shared.onMonitorChanged) shared.onMonitorChanged();
+    }
+
+    void Dispatch(const uint8_t* data, size_t size) {
+        using R = Route<PeerSession>;
+        static constexpr auto routes = MakeRoutes<PeerSession>({
+            {MSG_AUTH_REQUEST, sizeof(AuthRequestMsg), R::UNAUTHENTICATED, &PeerSession::OnAuthRequest},
+            {MSG_MOUSE_MOVE, 4, R::CONTROL, &PeerSession::OnInput}, {MSG_MOUSE_REL, 4, R::CONTROL, &PeerSession::OnInput},
+            {MSG_MOUSE_BTN, 4, R::CONTROL, &PeerSession::OnInput}, {MSG_MOUSE_WHEEL, 4, R::CONTROL, &PeerSession::OnInput},
+            {MSG_KEY, 4, R::CONTROL, &PeerSession::OnInput},
+            {MSG_PING, 16, R::EXACT, &PeerSession::OnPing},
+            {MSG_FPS_SET, 7, R::EXACT, &PeerSession::OnFpsSet},
+            {MSG_REQUEST_KEY, 4, 0, &PeerSession::OnRequestKey},
+            {MSG_CURSOR_REQUEST, 8, 0, &PeerSession::OnCursorRequest},
+            {MSG_NACK, 10, 0, &PeerSession::HandleNack},
+            {MSG_FRAME_LOSS, 12, 0, &PeerSession::HandleFrameLoss},
+            {MSG_TRACE_REPORT, 6, 0, &PeerSession::HandleTraceReport},
+            {MSG_NET_REPORT, 12, 0, &PeerSession::OnNetReport},
+            {MSG_AUDIO_CONFIG, sizeof(AudioConfigMsg), R::CONTROL, &PeerSession::OnAudioConfig},
+            {MSG_PRESENT_REPORT, sizeof(PresentReportMsg), R::CONTROL, &PeerSession::OnPresentReport},
+            {MSG_MONITOR_SET, 5, R::EXACT | R::CONTROL, &PeerSession::OnMonitorSet},
+        });
+        if (size < 4) return;
+        uint32_t magic; memcpy(&magic, data, 4);
+        const R* r = routes.Find(magic, size);
+        if (!r || (!(r->flags & R::UNAUTHENTICATED) && !authenticated) || ((r->flags & R::CONTROL) && !IsController())) return;
+        (this->*r->handler)(data, size);
+    }
+
+    // A BATCH record carries several small messages from one client task, e.g. input together with a ping
+    void HandleMessage(const rtc::binary& msg) {
+        auto* data = reinterpret_cast<const uint8_t*>(msg.data());
+        if (Wire::IsCompact(data, msg.size())) {
+            if (data[0] == Wire::BATCH) Wire::ForEachInBatch(data, msg.size(), [this](const uint8_t* d, size_t n) { if (!Wire::IsCompact(d, n)) Dispatch(d, n); });
+            return;
+        }
+        Dispatch(data, msg.size());
+    }
+
+    void End() {
+        bool was = connected.exchange(false);
+        fpsReceived = authenticated = false; overflowCount = 0;
+        if (!closed.exchange(true)) closedAt = GetTimestamp();
+        uint64_t self = id;
+        if (shared.controllerId.compare_exchange_strong(self, 0)) shared.cadence.Reset();
+        queueCondition.notify_all();
+        if (was && shared.onSessionEnded) shared.onSessionEnded();
+    }
+
+    bool IsConnectionStale() {
+        if (!connected) return false;
+        int64_t lastPing = lastPingTime.load(), now = GetTimestamp() / 1000;
+        if (lastPing > 0 && (now - lastPing) > 3000) { if (!pingTimeout.exchange(true)) WARN("Peer %llu ping timeout", id); return true; }
+        return overflowCount >= 10;
+    }
+
+    void SendFrame(const OutgoingFrame& out) {
+        auto ch = channels[VIDEO];
+        if (!ch || !ch->isOpen()) { if (connected) ForceDisconnect("Channel closed"); return; }
+        if (IsConnectionStale()) { ForceDisconnect("Stale connection"); return; }
+        const EncodedFrame& frame = out.frame;
+
+        // libdatachannel sends the whole temporal unit at once; the viewer's RTCP drives NACK repair and PLI keyframes
+        if (rtpMode) {
+            if (frame.data.empty()) return;
+            if (!rtp.SendVideo(frame)) { shared.dropCount++; DropUntilKey(); return; }
+            shared.byteCount += frame.data.size(); shared.sentCount++;
+            if (!frame.layer) g_sendLatency.Observe(GetTimestamp() - frame.ts);
+            return;
+        }
+
+        try {
+            if (Buffered(ch) > HARD_BUFFER_LIMIT) { overflowCount++; shared.dropCount++; DropUntilKey(); if (overflowCount >= 10) ForceDisconnect("Buffer overflow"); return; }
+            overflowCount = 0;
+
+            if (frame.data.empty()) return;
+
+            // Decided before the first chunk: a delta that cannot drain within a couple of frame intervals is dropped
+            // whole instead of being abandoned halfway once the buffer fills
+            pacer.SetTargetBitrate(congestion.GetTargetBitrate());
+            int64_t intervalUs = 1000000 / std::max(1, shared.currentFps.load());
+            if (!frame.isKey && pacer.DrainUs(Buffered(ch) + frame.data.size()) > intervalUs * MAX_DRAIN_FRAMES) { shared.dropCount++; DropUntilKey(); return; }
+
+            CachedFrame cached;
+            if (frame.isKey) { lastKeyId = out.id; cached.id = out.id; cached.packets.reserve(frame.data.size() + frame.data.size() / 64); }
+
+            size_t index = 0;
+            auto res = packetizer.Packetize(frame, out.id, static_cast<size_t>(congestion.GetFecGroupSize()), epochUs, [&](rtc::binary& pkt, bool parity) {
+                if (!pacer.Wait()) return false;
+                if (parity) return SafeSend(std::move(pkt));
+                if (index && (index % 16) == 0 && Buffered(ch) > HARD_BUFFER_LIMIT) { overflowCount++; shared.dropCount++; DropUntilKey(); return false; }
+                // Copied for NACK repair before the message is handed over; an abandoned keyframe is never cached
+                if (frame.isKey) {
+                    auto* p = reinterpret_cast<const uint8_t*>(pkt.data());
+                    cached.offsets.push_back(static_cast<uint32_t>(cached.packets.size()));
+                    cached.packets.insert(cached.packets.end(), p, p + pkt.size());
+                }
+                if (!SafeSend(std::move(pkt))) { overflowCount++; shared.dropCount++; DropUntilKey(); return false; }
+                if (index++ == 0 && !frame.layer) Trace::Mark(Trace::FirstChunk, frame.ts);
+                return true;
+            });
+            shared.parityCount += res.parity;
+            if (size_t sent = res.bytes) { shared.byteCount += sent; shared.sentCount++; if (!frame.layer) { Trace::Mark(Trace::LastChunk, frame.ts); g_sendLatency.Observe(GetTimestamp() - frame.ts); } }
+            if (frame.isKey && res.chunks == res.total) CacheKeyframe(std::move(cached));
+        } catch (...) { shared.dropCount++; DropUntilKey(); overflowCount++; }
+    }
+
+    // A delta missing from this viewer's stream corrupts every later one, so skip to the next keyframe
+    void DropUntilKey() {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        queue.clear();
+        if (!waitingKey) { waitingKey = true; needsKeyframe = true; }
+    }
+
+    void SenderLoop() {
+        while (true) {
+            std::shared_ptr<const OutgoingFrame> next;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueCondition.wait_for(lock, 100ms, [this] { return stopping || !queue.empty(); });
+                if (stopping) return;
+                if (queue.empty()) {
+                    lock.unlock();
+                    if (const char* reason = kickReason.exchange(nullptr)) { std::this_thread::sleep_for(100ms); ForceDisconnect(reason); }
+                    else if (IsConnectionStale()) ForceDisconnect("Stale connection");
+                    continue;
+                }
+                next = std::move(queue.front()); queue.pop_front();
+            }
+            SendFrame(*next);
+        }
+    }
+
+public:
+    PeerSession(uint64_t sessionId, SessionShared& sharedState, const rtc::Configuration& config) : id(sessionId), shared(sharedState) {
+        if (shared.link.IsActive()) impairment = std::make_unique<LinkImpairment>(shared.link);
+        connected = true;
+        peerConnection = std::make_shared<rtc::PeerConnection>(config);
+
+        peerConnection->onLocalDescription([this](rtc::Description d) {
+            std::lock_guard<std::mutex> lock(descMutex);
+            localDescription = std::string(d);
+            hasLocalDescription = true;
+            descCondition.notify_all();
+        });
+
+        peerConnection->onLocalCandidate([this](rtc::Candidate) { if (++candidateCount >= 2) descCondition.notify_all(); });
+
+        peerConnection->onStateChange([this](auto state) {
+            if (state == rtc::PeerConnection::State::Connected) {
+                if (!connected.exchange(true)) needsKeyframe = true;
+                lastPingTime = GetTimestamp() / 1000;
+                LOG("Peer %llu connected", id);
+            } else if (state == rtc::PeerConnection::State::Disconnected || state == rtc::PeerConnection::State::Failed ||
+                       state == rtc::PeerConnection::State::Closed) End();
+        });
+
+        peerConnection->onGatheringStateChange([this](auto state) {
+            if (state == rtc::PeerConnection::GatheringState::Complete) { gatheringComplete = true; descCondition.notify_all(); }
+        });
+
+        peerConnection->onDataChannel([this](auto ch) {
+            auto it = std::find_if(std::begin(CHANNEL_LABELS), std::end(CHANNEL_LABELS), [&](const char* l) { return ch->label() == l; });
+            if (it == std::end(CHANNEL_LABELS)) return;
+            auto c = static_cast<Channel>(it - std::begin(CHANNEL_LABELS));
+            channels[c] = ch;
+            if (c == VIDEO) {
+                if (impairment) impairment->Attach(ch);
+                ch->onOpen([this] { connected = needsKeyframe = true; authenticated = false; lastPingTime = GetTimestamp() / 1000; overflowCount = authAttempts = 0; LOG("Peer %llu data channel opened", id); });
+            }
+            ch->onClosed([this] { End(); });
+            ch->onMessage([this](auto data) { if (auto* b = std::get_if<rtc::binary>(&data)) HandleMessage(*b); });
+        });
+
+        sender = std::thread([this] { SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST); Trace::NameThread(("send peer " + std::to_string(id)).c_str()); SenderLoop(); });
+    }
+
+    ~PeerSession() {
+        { std::lock_guard<std::mutex> lock(queueMutex); stopping = true; }
+        queueCondition.notify_all();
+        pacer.Stop();
+        if (sender.joinable()) sender.join();
+        impairment.reset();
+        rtp.Close();
+        for (auto& ch : channels) try { if (ch) { ch->resetCallbacks(); ch->close(); } } catch (...) {}
+        try { peerConnection->resetCallbacks(); peerConnection->close(); } catch (...) {}
+    }
+
+    PeerSession(const PeerSession&) = delete;
+    PeerSession& operator=(const PeerSession&) = delete;
+
+    // Applies the offer and returns the answer once a couple of host candidates are in; LAN peers rarely need the rest.
+    // wantRtp answers the offer's AV1 and Opus sections with tracks; without an AV1 section video stays on DataChannels.
+    std::string Answer(const std::string& sdp, bool wantRtp = false) {
+        rtc::Description offer(sdp, "offer");
+        if (wantRtp && !(rtpMode = rtp.Attach(*peerConnection, offer, [this] { needsKeyframe = true; })))
+            WARN("Peer %llu asked for RTP but offered no AV1 video; using DataChannel chunks", id);
+        peerConnection->setRemoteDescription(offer);
+        peerConnection->setLocalDescription();
+
+        std::unique_lock<std::mutex> lock(descMutex);
+        if (!descCondition.wait_for(lock, 200ms, [this] { return hasLocalDescription.load(); })) {
+            WARN("Peer %llu: timeout waiting for local description", id);
+            return localDescription;
+        }
+        descCondition.wait_for(lock, 150ms, [this] { return gatheringComplete.load() || candidateCount.load() >= 2; });
+        LOG("Peer %llu answer with %d candidates (gathering %s)", id, candidateCount.load(), gatheringComplete.load() ? "complete" : "partial");
+        return localDescription;
+    }
+
+    void ForceDisconnect(const char* reason) {
+        if (closed) return;
+        WARN("Peer %llu disconnect: %s", id, reason);
+        for (auto& ch : channels) try { if (ch) ch->close(); } catch (...) {}
+        try { peerConnection->close(); } catch (...) {}
+        End();
+    }
+
+    // Moves between the full and half-size rung on this viewer's own estimate, holding each choice a few seconds
+    void UpdateLayer(int layerCount, int64_t nowUs) {
+        int cur = wantedLayer, next = cur;
+        int64_t bps = congestion.GetTargetBitrate();
+        if (layerCount < 2) next = 0;
+        else if (nowUs - lastLayerSwitch < LAYER_HOLD_US) return;
+        else if (cur == 0 && bps < LOW_LAYER_DOWN_BPS) next = 1;
+        else if (cur == 1 && bps > LOW_LAYER_UP_BPS) next = 0;
+        if (next == cur) return;
+        lastLayerSwitch = nowUs; wantedLayer = next; needsKeyframe = true;
+        LOG("Peer %llu switching to layer %d (%.1f Mbps)", id, next, bps / 1e6);
+    }
+
+    // Hands a frame to the sender thread; returns false if it was dropped for this viewer
+    bool Enqueue(const std::shared_ptr<const OutgoingFrame>& frame) {
+        if (!IsStreaming()) return false;
+        const EncodedFrame& f = frame->frame;
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (f.isKey && f.layer == wantedLayer) layer = f.layer;
+        if (f.layer != layer) return false;
+        if (f.stream != stream) {
+            if (!f.isKey) { waitingKey = needsKeyframe = true; return false; }
+            stream = f.stream;
+        }
+        if (f.isKey) { queue.clear(); waitingKey = false; }
+        else if (waitingKey) { shared.dropCount++; return false; }
+        else if (queue.size() >= MAX_QUEUE) {
+            queue.clear(); waitingKey = needsKeyframe = true; shared.dropCount++;
+            return false;
+        }
+        queue.push_back(frame);
+        queueCondition.notify_one();
+        return true;
+    }
+
+    void SendCursor(const CursorPosMsg& pos, const CursorTracker::Shape& shape) {
+        if (!IsStreaming()) return;
+        if (shape) SafeSend(shape->data(), shape->size(), CONTROL);
+        // A stale position is worth nothing once the next one is due, so a backed-up input channel skips it
+        auto ch = Pick(INPUT);
+        if (ch && ch->isOpen() && Buffered(ch) <= INPUT_BUFFER_LIMIT) SafeSend(&pos, sizeof(pos), INPUT);
+    }
+
+    // Only audioThread calls these, so the batch needs no lock. With the channel backing up, small frames are held
+    // and go out together (header and payload repeated per packet), at most AUDIO_BATCH_US late and one MTU long.
+    void SendAudio(const uint8_t* data, size_t size, int64_t ts, int samples) {
+        if (rtpMode && rtp.IsAudioOpen()) { if (IsStreaming() && rtp.SendAudio(data, size, ts)) shared.audioSentCount++; return; }
+        auto ch = Pick(AUDIO);
+        if (!IsStreaming() || overflowCount >= 5 || !ch || !ch->isOpen() || Buffered(ch) > AUDIO_BUFFER_LIMIT) { audioBatch.clear(); audioBatched = 0; return; }
+
+        try {
+            AudioPacketHeader hdr = {MSG_AUDIO_DATA, ts, static_cast<uint16_t>(samples), static_cast<uint16_t>(size)};
+            if (audioBatch.size() + sizeof(hdr) + size > AUDIO_BATCH_BYTES) FlushAudio();
+            if (audioBatch.empty()) { audioBatch.reserve(AUDIO_BATCH_BYTES); audioBatchAt = GetTimestamp(); }
+            size_t off = audioBatch.size();
+            audioBatch.resize(off + sizeof(hdr) + size);
+            memcpy(audioBatch.data() + off, &hdr, sizeof(hdr));
+            memcpy(audioBatch.data() + off + sizeof(hdr), data, size);
+            audioBatched++;
+            if (Buffered(ch) <= AUDIO_BUFFER_LIMIT / 4 || GetTimestamp() - audioBatchAt >= AUDIO_BATCH_US) FlushAudio();
+        } catch (...) {}
+    }
+
+    void FlushAudio() {
+        if (audioBatch.empty()) return;
+        size_t total = audioBatch.size();
+        uint64_t count = std::exchange(audioBatched, 0);
+        if (SafeSend(std::move(audioBatch), AUDIO)) { shared.byteCount += total; shared.audioSentCount += count; }
+        audioBatch = {};
+    }
+
+    // HOST_INFO: magic, host fps u16, bit depth u8, wire version u8, chunk timestamp epoch i64
+    void SendHostInfo() {
+        uint8_t buf[16];
+        *reinterpret_cast<uint32_t*>(buf) = MSG_HOST_INFO;
+        *reinterpret_cast<uint16_t*>(buf + 4) = static_cast<uint16_t>(shared.getHostFps ? shared.getHostFps() : 60);
+        buf[6] = static_cast<uint8_t>(shared.getBitDepth ? shared.getBitDepth() : 8);
+        buf[7] = Wire::VERSION;
+        memcpy(buf + 8, &epochUs, 8);
+        SafeSend(buf, sizeof(buf), CONTROL);
+    }
+
+    void SendMonitorList() {
+        std::lock_guard<std::mutex> lock(g_monitorsMutex);
+        std::vector<uint8_t> buf(6 + g_monitors.size() * 74);
+        size_t off = 0;
+
+        *reinterpret_cast<uint32_t*>(&buf[off]) = MSG_MONITOR_LIST; off += 4;
+        buf[off++] = static_cast<uint8_t>(g_monitors.size());
+        buf[off++] = static_cast<uint8_t>(shared.getCurrentMonitor ? shared.getCurrentMonitor() : 0);
+
+        for (const auto& m : g_monitors) {
+            buf[off++] = static_cast<uint8_t>(m.index);
+            *reinterpret_cast<uint16_t*>(&buf[off]) = static_cast<uint16_t>(m.width);
+            *reinterpret_cast<uint16_t*>(&buf[off + 2]) = static_cast<uint16_t>(m.height);
+            *reinterpret_cast<uint16_t*>(&buf[off + 4]) = static_cast<uint16_t>(m.refreshRate);
+            off += 6;
+            buf[off++] = m.isPrimary ? 1 : 0;
+            size_t nl = std::min(m.name.size(), size_t(63));
+            buf[off++] = static_cast<uint8_t>(nl);
+            memcpy(&buf[off], m.name.c_str(), nl);
+            off += nl;
+        }
+        SafeSend(buf.data(), off, CONTROL);
+    }
+
+    // Sampled once per captured frame; true when this viewer's channel is backed up past the soft threshold
+    bool SampleCongested() {
+        auto ch = channels[VIDEO];
+        if (!ch || !ch->isOpen()) return false;
+        size_t buffered = Buffered(ch);
+        congestion.OnBufferedAmount(buffered, GetTimestamp());
+        return buffered > BUFFER_THRESHOLD;
+    }
+
+    bool TakeKeyRequest(int forLayer) { return wantedLayer == forLayer && needsKeyframe.exchange(false); }
+    bool ReceivesLayer(int l) const { return layer == l || wantedLayer == l; }
+    int GetWantedLayer() const { return wantedLayer; }
+    void RequestKeyframe() { needsKeyframe = true; }
+    uint64_t GetId() const { return id; }
+    bool IsClosed() const { return closed; }
+    // Closed long enough that no libdatachannel callback can still be running on this session
+    bool IsExpired(int64_t nowUs) const { return closed && nowUs - closedAt > 1000000; }
+    bool IsConnected() const { return connected; }
+    bool IsAuthenticated() const { return authenticated; }
+    bool IsFpsReceived() const { return fpsReceived; }
+    bool IsStreaming() const { return connected && authenticated && fpsReceived; }
+    bool IsController() const { return shared.controllerId == id; }
+    bool IsRtp() const { return rtpMode; }
+    int64_t GetTargetBitrate() const { return congestion.GetTargetBitrate(); }
+    int GetFecGroupSize() { return congestion.GetFecGroupSize(); }
+};
@@ -0,0 +1,150 @@
+/**
+ * @file trace.hpp
+ * @brief Per-frame pipeline tracing with per-thread lock-free rings, Chrome trace export and stage percentiles
+ * @copyright 2025-2026 Daniel Chrobak
+ */
+
+#pragma once
+#include "common.hpp"
+#include <array>
+
+class Trace {
+public:
+    // In pipeline order; each span in the export runs from the previous stage seen for that frame
+    enum Stage : uint8_t {
+        WgcArrival, PoolConvert, FenceReady, EncodeStart, EncodeEnd, FirstChunk, LastChunk,
+        ClientReceive, ClientDecode, ClientPresent, STAGE_COUNT
+    };
+
+private:
+    static constexpr uint32_t RING_SIZE = 4096;
+
+    struct Event { int64_t frameTs, atUs; Stage stage; };
+
+    // Written only by its owning thread; readers copy and then discard whatever the writer lapped meanwhile.
+    // Events before base belong to the ring's previous owner.
+    struct Ring {
+        Event events[RING_SIZE];
+        std::atomic<uint64_t> head{0};
+        uint64_t base = 0;
+        std::string name;
+        int tid;
+    };
+
+    static inline std::mutex registryMutex;
+    static inline std::vector<std::unique_ptr<Ring>> rings;
+    static inline std::vector<Ring*> freeRings;
+    static inline std::atomic<bool> enabled{true};
+
+    static constexpr const char* STAGE_NAMES[STAGE_COUNT] = {
+        "wgc_arrival", "pool_convert", "fence_ready", "encode_start", "encode_end", "first_chunk", "last_chunk",
+        "client_receive", "client_decode", "client_present"
+    };
+
+    // A finished thread's ring goes on the free list, so threads that come and go (one sender per peer) reuse rings
+    // instead of adding one per connection. Its events stay exportable until the next thread takes it over.
+    struct Owner {
+        Ring* ring;
+        Owner() {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            if (!freeRings.empty()) { ring = freeRings.back(); freeRings.pop_back(); ring->base = ring->head.load(std::memory_order_relaxed); }
+            else { rings.push_back(std::make_unique<Ring>()); ring = rings.back().get(); ring->tid = static_cast<int>(rings.size()); }
+            ring->name = "thread " + std::to_string(ring->tid);
+        }
+        ~Owner() { std::lock_guard<std::mutex> lock(registryMutex); freeRings.push_back(ring); }
+    };
+
+    static Ring& Local() {
+        static thread_local Owner owner;
+        return *owner.ring;
+    }
+
+    static std::vector<std::pair<const Ring*, std::vector<Event>>> Snapshot() {
+        std::vector<std::pair<const Ring*, std::vector<Event>>> out;
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (const auto& r : rings) {
+            uint64_t end = r->head.load(std::memory_order_acquire), begin = std::max(r->base, end > RING_SIZE ? end - RING_SIZE : 0);
+            std::vector<Event> ev;
+            ev.reserve(static_cast<size_t>(end - begin));
+            for (uint64_t i = begin; i < end; i++) ev.push_back(r->events[i % RING_SIZE]);
+            // The fence keeps the copies ahead of the re-read. Record overwrites slot `lapped` before publishing it, so
+            // the entry sharing that slot may be torn too, not just the ones the writer has published past
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint64_t lapped = r->head.load(std::memory_order_relaxed);
+            size_t stale = lapped + 1 > begin + RING_SIZE ? static_cast<size_t>(std::min<uint64_t>(lapped + 1 - begin - RING_SIZE, ev.size())) : 0;
+            ev.erase(ev.begin(), ev.begin() + stale);
+            out.emplace_back(r.get(), std::move(ev));
+        }
+        return out;
+    }
+
+    struct Span { Stage stage; int64_t startUs, endUs, frameTs; int tid; };
+
+    // Orders each frame's events by stage and pairs neighbours into spans
+    static std::vector<Span> BuildSpans() {
+        struct Mark { int64_t atUs; int tid; bool set = false; };
+        std::unordered_map<int64_t, std::array<Mark, STAGE_COUNT>> frames;
+        for (const auto& [ring, events] : Snapshot())
+            for (const auto& e : events) {
+                auto& m = frames[e.frameTs][e.stage];
+                if (!m.set) m = {e.atUs, ring->tid, true};
+            }
+
+        std::vector<Span> spans;
+        for (const auto& [ts, marks] : frames) {
+            int prev = -1;
+            for (int s = 0; s < STAGE_COUNT; s++) {
+                if (!marks[s].set) continue;
+                if (prev >= 0 && marks[s].atUs >= marks[prev].atUs)
+                    spans.push_back({static_cast<Stage>(s), marks[prev].atUs, marks[s].atUs, ts, marks[s].tid});
+                prev = s;
+            }
+        }
+        return spans;
+    }
+
+public:
+    static void SetEnabled(bool on) { enabled = on; }
+    static bool IsEnabled() { return enabled.load(std::memory_order_relaxed); }
+    static void NameThread(const char* name) { Ring& r = Local(); std::lock_guard<std::mutex> lock(registryMutex); r.name = name; }
+
+    // frameTs is the capture timestamp, which every stage of a frame carries; atUs is on the GetTimestamp clock
+    static void Record(Stage stage, int64_t frameTs, int64_t atUs) {
+        if (!IsEnabled() || stage >= STAGE_COUNT) return;
+        Ring& r = Local();
+        uint64_t h = r.head.load(std::memory_order_relaxed);
+        r.events[h % RING_SIZE] = {frameTs, atUs, stage};
+        r.head.store(h + 1, std::memory_order_release);
+    }
+
+    static void Mark(Stage stage, int64_t frameTs) { Record(stage, frameTs, GetTimestamp()); }
+
+    // Chrome trace event format: one complete event per stage span, plus thread names
+    static std::string ExportChrome() {
+        json events = json::array();
+        {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            for (const auto& r : rings)
+                events.push_back({{"ph", "M"}, {"name", "thread_name"}, {"pid", 1}, {"tid", r->tid}, {"args", {{"name", r->name}}}});
+        }
+        for (const auto& s : BuildSpans())
+            events.push_back({{"ph", "X"}, {"name", STAGE_NAMES[s.stage]}, {"cat", "frame"}, {"pid", 1}, {"tid", s.tid},
+                              {"ts", s.startUs}, {"dur", s.endUs - s.startUs}, {"args", {{"frame", s.frameTs}}}});
+        return json{{"traceEvents", events}, {"displayTimeUnit", "ms"}}.dump();
+    }
+
+    // p50/p99 in microseconds of the time spent reaching each stage from the one before it
+    static std::string ExportStats() {
+        std::vector<int64_t> durations[STAGE_COUNT];
+        for (const auto& s : BuildSpans()) durations[s.stage].push_back(s.endUs - s.startUs);
+        json out = json::object();
+        for (int s = 0; s < STAGE_COUNT; s++) {
+            auto& d = durations[s];
+            if (d.empty()) continue;
+            std::sort(d.begin(), d.end());
+            auto pct = [&d](double p) { return d[std::min(d.size() - 1, static_cast<size_t>(p * d.size()))]; };
+            out[STAGE_NAMES[s]] = {{"count", d.size()}, {"p50", pct(0.50)}, {"p99", pct(0.99)}, {"max", d.back()}};
+        }
+        return out.dump(2);
+    }
+};
@@ -4,7 +4,7 @@
  * @copyright 2025-2026 Daniel Chrobak
  */
 
-import { MSG, C, S, mkBuf } from './state.js';
+import { MSG, C, S, mkBuf, sendMsg } from './state.js';
 import { canvas, canvasW, canvasH, calcVp, renderZoomed } from './renderer.js';
 
 let tStartX = 0, tStartY = 0, tStartT = 0, tMoved = false, tDrag = false;
@@ -49,11 +49,25 @@ const send = (type, ...a) => {
     const buf = {
         move: () => { S.stats.moves++; return mkBuf(12, v => { v.setUint32(0, MSG.MOUSE_MOVE, true); v.setFloat32(4, a[0], true); v.setFloat32(8, a[1], true); }); },
         btn: () => { S.stats.clicks++; return mkBuf(6, v => { v.setUint32(0, MSG.MOUSE_BTN, true); v.setUint8(4, a[0]); v.setUint8(5, a[1] ? 1 : 0); }); },
+        rel: () => { S.stats.moves++; return mkBuf(8, v => { v.setUint32(0, MSG.MOUSE_REL, true); v.setInt16(4, clamp16(a[0]), true); v.setInt16(6, clamp16(a[1]), true); }); },
         wheel: () => mkBuf(8, v => { v.setUint32(0, MSG.MOUSE_WHEEL, true); v.setInt16(4, Math.round(a[0]), true); v.setInt16(6, Math.round(a[1]), true); }),
         key: () => { S.stats.keys++; return mkBuf(10, v => { v.setUint32(0, MSG.KEY, true); v.setUint16(4, a[0], true); v.setUint16(6, a[1], true); v.setUint8(8, a[2] ? 1 : 0); v.setUint8(9, a[3]); }); }
     }[type]();
 
-    try { S.dc.send(buf); } catch {}
+    sendMsg(buf, type === 'key' ? 'control' : 'input');
+};
+
+const clamp16 = v => Math.max(-32768, Math.min(32767, Math.round(v)));
+const isLocked = () => document.pointerLockElement === canvas;
+
+// Relative mode captures the pointer on the first click; the browser releases it on Escape
+const lockPointer = () => {
+    try { canvas.requestPointerLock({ unadjustedMovement: true })?.catch(() => canvas.requestPointerLock()); } catch { canvas.requestPointerLock(); }
+};
+
+export const setRelMouse = on => {
+    S.relMouse = on;
+    if (!on && isLocked()) document.exitPointerLock();
 };
 
 const toNorm = (cx, cy) => {
@@ -108,8 +122,17 @@ const handleEscapeKey = (e, down) => {
 };
 
 const H = {
-    move: e => { if (S.controlEnabled || S.touchEnabled) { const p = toNorm(e.clientX, e.clientY); if (p) send('move', p.x, p.y); } },
-    down: e => { if (S.controlEnabled || S.touchEnabled) { e.preventDefault(); send('btn', BMAP[e.button] ?? 0, true); } },
+    move: e => {
+        if (!S.controlEnabled && !S.touchEnabled) return;
+        if (isLocked()) { if (e.movementX || e.movementY) send('rel', e.movementX, e.movementY); return; }
+        const p = toNorm(e.clientX, e.clientY); if (p) send('move', p.x, p.y);
+    },
+    down: e => {
+        if (!S.controlEnabled && !S.touchEnabled) return;
+        e.preventDefault();
+        if (S.relMouse && !isLocked()) { lockPointer(); return; }
+        send('btn', BMAP[e.button] ?? 0, true);
+    },
     up: e => { if (S.controlEnabled || S.touchEnabled) { e.preventDefault(); send('btn', BMAP[e.button] ?? 0, false); } },
     wheel: e => { if (S.controlEnabled || S.touchEnabled) { e.preventDefault(); send('wheel', e.deltaX, e.deltaY); } },
     ctx: e => { if (S.controlEnabled) e.preventDefault(); },
@@ -133,6 +156,7 @@ export const enableControl = () => {
 export const disableControl = () => {
     if (!S.controlEnabled) return;
     S.controlEnabled = false;
+    if (isLocked()) document.exitPointerLock();
     console.info('Control disabled');
     canvas.removeEventListener('mousemove', H.move);
     canvas.removeEventListener('mousedown', H.down);
@@ -9,6 +9,7 @@ import { render } from './renderer.js';
 
 let reqKey = null;
 let sources = [];
+let rtpAudio = null;
 
 export const setReqKeyFn = fn => { reqKey = fn; };
 
@@ -36,7 +37,7 @@ export const initDecoder = async (force = false) => {
     S.decoder = dec;
 
     for (const [hw, label] of [[true, 'HW'], [false, 'SW']]) {
-        const cfg = { codec: C.CODEC, optimizeForLatency: true, latencyMode: 'realtime', hardwareAcceleration: hw ? 'prefer-hardware' : 'prefer-software' };
+        const cfg = { codec: S.bitDepth === 10 ? C.CODEC_10 : C.CODEC, optimizeForLatency: true, latencyMode: 'realtime', hardwareAcceleration: hw ? 'prefer-hardware' : 'prefer-software' };
         try {
             const sup = await VideoDecoder.isConfigSupported(cfg);
             if (sup.supported) { dec.configure(sup.config); S.hwAccel = label; console.info(`Decoder: ${label}`); break; }
@@ -58,11 +59,12 @@ export const decodeFrame = data => {
 
     try {
         const q = S.decoder.decodeQueueSize;
+        S.present.depth += q; S.present.n++;
         if ((q > 4 && !data.isKey) || q > 6) { reqKey?.(); S.stats.tDropDec++; return; }
         if (!Number.isFinite(data.capTs) || data.capTs < 0) { S.stats.tDropDec++; return; }
 
         const ds = performance.now();
-        S.frameMeta.set(data.capTs, { capTs: data.capTs, encMs: data.encMs, netMs: data.netMs, queueMs: ds - data.fcT, decStart: ds });
+        S.frameMeta.set(data.capTs, { capTs: data.capTs, encMs: data.encMs, netMs: data.netMs, queueMs: ds - data.fcT, decStart: ds, isKey: data.isKey, rcvT: data.rcvT });
         if (S.frameMeta.size > 30) [...S.frameMeta.keys()].sort((a, b) => a - b).slice(0, -20).forEach(k => S.frameMeta.delete(k));
 
         const dur = S.lastCapTs > 0 && data.capTs > S.lastCapTs ? data.capTs - S.lastCapTs : 16667;
@@ -71,6 +73,7 @@ export const decodeFrame = data => {
         S.decoder.decode(new EncodedVideoChunk({ type: data.isKey ? 'key' : 'delta', timestamp: data.capTs, duration: dur, data: data.buf }));
         S.stats.dec++;
         S.stats.tDec++;
+        S.lastGoodFid = data.fId;
         if (data.isKey) S.needKey = false;
     } catch (e) {
         console.error('Decode:', e.message);
@@ -145,11 +148,17 @@ export const handleAudioPkt = data => {
     S.stats.audio++;
     S.stats.tAudio++;
 
+    if (S.audioDecoder?.state !== 'configured') return;
+    // A congested host batches several packets into one message, each with its own header
     const v = new DataView(data);
-    const samples = v.getUint16(12, true), len = v.getUint16(14, true);
-    if (len > data.byteLength - C.AUDIO_HEADER || S.audioDecoder?.state !== 'configured') return;
-
-    try { S.audioDecoder.decode(new EncodedAudioChunk({ type: 'key', timestamp: performance.now() * 1000, duration: (samples / C.AUDIO_RATE) * 1e6, data: new Uint8Array(data, C.AUDIO_HEADER, len) })); } catch {}
+    let t = performance.now() * 1000;
+    for (let off = 0; off + C.AUDIO_HEADER <= data.byteLength;) {
+        const samples = v.getUint16(off + 12, true), len = v.getUint16(off + 14, true), dur = (samples / C.AUDIO_RATE) * 1e6;
+        if (len > data.byteLength - off - C.AUDIO_HEADER) return;
+        try { S.audioDecoder.decode(new EncodedAudioChunk({ type: 'key', timestamp: t, duration: dur, data: new Uint8Array(data, off + C.AUDIO_HEADER, len) })); } catch {}
+        off += C.AUDIO_HEADER + len;
+        t += dur;
+    }
 };
 
 export const toggleAudio = () => {
@@ -157,12 +166,13 @@ export const toggleAudio = () => {
 
     if (!S.audioEnabled) {
         initAudio().then(ok => {
-            if (ok) { S.audioEnabled = S.audioPlaying = true; S.audioNextTime = 0; btn.classList.add('on'); st.classList.add('on'); btnT.textContent = 'Disable'; stT.textContent = 'Audio active'; }
+            if (ok) { S.audioEnabled = S.audioPlaying = true; S.audioNextTime = 0; syncRtpAudio(); btn.classList.add('on'); st.classList.add('on'); btnT.textContent = 'Disable'; stT.textContent = 'Audio active'; }
             else stT.textContent = 'Audio failed';
         });
     } else {
         S.audioEnabled = S.audioPlaying = false;
         S.audioNextTime = 0;
+        syncRtpAudio();
         btn.classList.remove('on');
         st.classList.remove('on');
         btnT.textContent = 'Enable';
@@ -171,3 +181,24 @@ export const toggleAudio = () => {
 };
 
 export const closeAudio = () => S.audioCtx?.close();
+
+const syncRtpAudio = () => { if (!rtpAudio) return; rtpAudio.muted = !S.audioEnabled; if (S.audioEnabled) rtpAudio.play().catch(() => {}); };
+
+// RTP transport: the browser depacketizes, repairs and decodes, and frames are drawn as they come off the track.
+// Audio plays from a hidden element that follows the audio toggle.
+export const attachRtpTrack = (e, onFrame) => {
+    e.receiver.playoutDelayHint = 0;
+    if ('jitterBufferTarget' in e.receiver) e.receiver.jitterBufferTarget = 0;
+    if (e.track.kind === 'audio') { (rtpAudio ??= new Audio()).srcObject = new MediaStream([e.track]); syncRtpAudio(); return; }
+
+    const reader = new MediaStreamTrackProcessor({ track: e.track }).readable.getReader();
+    (async () => {
+        for (;;) {
+            const { value: f, done } = await reader.read().catch(() => ({ done: true }));
+            if (done) return;
+            S.stats.recv++; S.stats.tRecv++; S.stats.dec++; S.stats.tDec++;
+            render(f, undefined);
+            onFrame();
+        }
+    })();
+};
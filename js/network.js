@@ -4,10 +4,10 @@
  * @copyright 2025-2026 Daniel Chrobak
  */
 
-import './renderer.js';
+import { drawCursor, setCursorShape } from './renderer.js';
 import { setKeyboardLockFns } from './input.js';
-import { MSG, C, S, $, mkBuf, Stage } from './state.js';
-import { handleAudioPkt, closeAudio, initDecoder, decodeFrame, setReqKeyFn } from './media.js';
+import { MSG, C, S, $, mkBuf, sendMsg, WIRE, Stage } from './state.js';
+import { handleAudioPkt, closeAudio, initDecoder, decodeFrame, setReqKeyFn, attachRtpTrack } from './media.js';
 import { updateStats, updateMonOpts, updateFpsOpts, setNetCbs, updateLoadingStage, showLoading, hideLoading, isLoadingVisible, isKeyboardLocked, exitFullscreen } from './ui.js';
 
 setKeyboardLockFns(isKeyboardLocked, exitFullscreen);
@@ -23,9 +23,9 @@ const STUN_SERVERS = [
 
 const tsUs = (t = performance.now()) => Math.floor((performance.timeOrigin + t) * 1000);
 const toSrvUs = t => tsUs(t) - S.clockOff;
-const sendMsg = buf => { if (S.dc?.readyState !== 'open') return false; try { S.dc.send(buf); return true; } catch { return false; } };
 
-let creds = null, authResolve = null, authReject = null, hasConnected = false, waitFirstFrame = false, connAttempts = 0, pingInterval = null;
+let creds = null, authResolve = null, authReject = null, hasConnected = false, waitFirstFrame = false, connAttempts = 0, pingInterval = null, reportInterval = null;
+let lastLossAt = 0;
 let useStunServers = false; // Start without STUN for faster LAN connections
 
 const connEl = { overlay: $('connectOverlay'), url: $('localUrlInput'), btn: $('connectLocalBtn'), err: $('connectError') };
@@ -38,7 +38,10 @@ const validCreds = c => c && validUser(c.username) && validPin(c.pin);
 const getSaved = () => { try { return JSON.parse(localStorage.getItem(AUTH_KEY)); } catch { return null; } };
 const saveCreds = (u, p) => { try { localStorage.setItem(AUTH_KEY, JSON.stringify({ username: u, pin: p })); } catch {} };
 const clearCreds = () => { try { localStorage.removeItem(AUTH_KEY); } catch {} };
-const clearPing = () => { if (pingInterval) { clearInterval(pingInterval); pingInterval = null; } };
+const clearPing = () => {
+    if (pingInterval) { clearInterval(pingInterval); pingInterval = null; }
+    if (reportInterval) { clearInterval(reportInterval); reportInterval = null; }
+};
 
 const loadConnSettings = () => { try { const s = JSON.parse(localStorage.getItem(CONN_KEY)); if (s?.localUrl) connEl.url.value = s.localUrl; } catch {} };
 const saveConnSettings = () => { try { localStorage.setItem(CONN_KEY, JSON.stringify({ localUrl: connEl.url.value })); } catch {} };
@@ -51,7 +54,6 @@ const showAuthModal = (err = '') => { authEl.user.value = authEl.pin.value = '';
 const hideAuthModal = () => { authEl.overlay.classList.remove('visible'); setAuthErr('', null); };
 
 const sendAuth = (u, p) => {
-    if (S.dc?.readyState !== 'open') return console.error('DC not open for auth'), false;
     const ub = new TextEncoder().encode(u), pb = new TextEncoder().encode(p);
     const buf = new ArrayBuffer(6 + ub.length + pb.length), v = new DataView(buf);
     v.setUint32(0, MSG.AUTH_REQUEST, true);
@@ -59,7 +61,9 @@ const sendAuth = (u, p) => {
     v.setUint8(5, pb.length);
     new Uint8Array(buf, 6).set(ub);
     new Uint8Array(buf, 6 + ub.length).set(pb);
-    try { S.dc.send(buf); console.info('Auth request sent'); return true; } catch (e) { console.error('Auth send failed:', e); return false; }
+    if (!sendMsg(buf, 'control')) return console.error('DC not open for auth'), false;
+    console.info('Auth request sent');
+    return true;
 };
 
 const handleAuthResp = data => {
@@ -116,9 +120,62 @@ authEl.btn.addEventListener('click', () => {
 
 $('disconnectBtn')?.addEventListener('click', () => { cleanup(); hasConnected = false; showConnModal(); });
 
-export const sendMonSel = i => sendMsg(mkBuf(5, v => { v.setUint32(0, MSG.MONITOR_SET, true); v.setUint8(4, i); }));
-export const sendFps = (fps, mode) => sendMsg(mkBuf(7, v => { v.setUint32(0, MSG.FPS_SET, true); v.setUint16(4, fps, true); v.setUint8(6, mode); }));
-export const reqKey = () => sendMsg(mkBuf(4, v => v.setUint32(0, MSG.REQUEST_KEY, true)));
+export const sendMonSel = i => sendMsg(mkBuf(5, v => { v.setUint32(0, MSG.MONITOR_SET, true); v.setUint8(4, i); }), 'control');
+export const sendFps = (fps, mode) => sendMsg(mkBuf(7, v => { v.setUint32(0, MSG.FPS_SET, true); v.setUint16(4, fps, true); v.setUint8(6, mode); }), 'control');
+export const reqKey = () => sendMsg(mkBuf(4, v => v.setUint32(0, MSG.REQUEST_KEY, true)), 'control');
+
+const sendNetReport = () => {
+    const { tRecv, tDropNet, tChunks, tChunkLost } = S.stats, r = S.lossRef;
+    if (sendMsg(mkBuf(20, v => {
+        v.setUint32(0, MSG.NET_REPORT, true); v.setUint32(4, tRecv - r.recv, true); v.setUint32(8, tDropNet - r.drop, true);
+        v.setUint32(12, tChunks - r.chunks - (tChunkLost - r.lost), true); v.setUint32(16, tChunkLost - r.lost, true);
+    }))) S.lossRef = { recv: tRecv, drop: tDropNet, chunks: tChunks, lost: tChunkLost };
+};
+
+// With RTP tracks the browser reassembles frames, so the same report is built from its inbound-rtp counters
+let rtpRef = null;
+const sendRtpNetReport = async () => {
+    const st = await S.pc?.getStats().catch(() => null);
+    let v = null;
+    st?.forEach(r => { if (r.type === 'inbound-rtp' && r.kind === 'video') v = r; });
+    if (!v) return;
+    const cur = { recv: v.framesReceived ?? 0, drop: v.framesDropped ?? 0, pkts: v.packetsReceived ?? 0, lost: Math.max(0, v.packetsLost ?? 0) }, r = rtpRef;
+    if (r && sendMsg(mkBuf(20, b => {
+        b.setUint32(0, MSG.NET_REPORT, true); b.setUint32(4, Math.max(0, cur.recv - r.recv), true); b.setUint32(8, Math.max(0, cur.drop - r.drop), true);
+        b.setUint32(12, Math.max(0, cur.pkts - r.pkts), true); b.setUint32(16, Math.max(0, cur.lost - r.lost), true);
+    })) || !r) rtpRef = cur;
+};
+
+// Tells the host which delta never arrived so it can refresh from the last frame we decoded
+const sendFrameLoss = id => {
+    const now = performance.now();
+    if (now - lastLossAt < C.LOSS_MIN_MS) return;
+    if (sendMsg(mkBuf(12, v => { v.setUint32(0, MSG.FRAME_LOSS, true); v.setUint32(4, S.lastGoodFid, true); v.setUint32(8, id, true); }))) lastLossAt = now;
+};
+
+// Client-side stage times for the host's frame trace, converted to its clock; needs clock sync to line up
+const sendTraceReport = () => {
+    const t = S.trace;
+    S.trace = [];
+    if (!S.clockSync || !t.length) return;
+    sendMsg(mkBuf(6 + t.length * 32, v => {
+        v.setUint32(0, MSG.TRACE_REPORT, true); v.setUint16(4, t.length, true);
+        t.forEach((e, i) => [e.cap, toSrvUs(e.rcv), toSrvUs(e.dec), toSrvUs(e.pres)].forEach((x, j) => v.setBigInt64(6 + i * 32 + j * 8, BigInt(Math.round(x)), true)));
+    }));
+};
+
+// Where this display's vsync falls and how long frames take to be decoded, both on the host's clock, for its capture cadence
+const sendPresentReport = () => {
+    const p = S.present, v = S.vsync, d = p.dec, depth = p.n ? p.depth / p.n : 0;
+    S.present = { dec: [], depth: 0, n: 0 };
+    if (!S.clockSync || !v.period || !d.length) return;
+    const leads = d.map(([cap, dec]) => toSrvUs(dec) - cap).sort((a, b) => a - b), lead = leads[(leads.length * 3) >> 2];
+    if (!(lead > 0 && lead < 1e6)) return;
+    sendMsg(mkBuf(22, b => {
+        b.setUint32(0, MSG.PRESENT_REPORT, true); b.setBigInt64(4, BigInt(Math.round(toSrvUs(v.t))), true);
+        b.setUint32(12, Math.round(v.period * 1000), true); b.setUint32(16, Math.round(lead), true); b.setUint16(20, Math.min(65535, Math.round(depth * 100)), true);
+    }));
+};
 
 setReqKeyFn(reqKey);
 
@@ -154,6 +211,27 @@ export const selDefFps = () => {
     return +sel.value;
 };
 
+const AUDIO_PROFILE_KEY = 'audio_profile';
+try { const p = localStorage.getItem(AUDIO_PROFILE_KEY); if (C.AUDIO_PROFILES[p]) S.audioProfile = p; } catch {}
+
+export const sendAudioCfg = (name = S.audioProfile) => {
+    const p = C.AUDIO_PROFILES[name];
+    if (!p) return false;
+    S.audioProfile = name;
+    try { localStorage.setItem(AUDIO_PROFILE_KEY, name); } catch {}
+    return sendMsg(mkBuf(9, v => { v.setUint32(0, MSG.AUDIO_CONFIG, true); v.setUint16(4, p.frameUs, true); v.setUint16(6, p.kbps, true); v.setUint8(8, (p.fec ? 1 : 0) | (p.dtx ? 2 : 0)); }), 'control');
+};
+
+const TRANSPORT_KEY = 'transport';
+try { if (localStorage.getItem(TRANSPORT_KEY) === 'rtp') S.transport = 'rtp'; } catch {}
+
+// Negotiated with the offer, so a change takes a fresh connection
+export const setTransport = name => {
+    if (name === S.transport) return;
+    try { localStorage.setItem(TRANSPORT_KEY, name); } catch {}
+    location.reload();
+};
+
 export const applyFps = val => {
     const fps = +val, mode = fps === S.hostFps ? 1 : fps === S.clientFps ? 2 : 0;
     if (sendFps(fps, mode)) { S.currentFps = fps; S.currentFpsMode = mode; S.fpsSent = true; }
@@ -161,15 +239,61 @@ export const applyFps = val => {
 
 const isNewer = (n, l) => { const d = (n - l) >>> 0; return d > 0 && d < 0x80000000; };
 
+// Asks for just the missing chunks of an incomplete keyframe; false once retries are spent and a new keyframe is needed
+const sendNack = (id, fr, rt) => {
+    if (fr.nackAt && rt - fr.nackAt < Math.max(C.NACK_MIN_MS, S.rtt * 1.5)) return true;
+    if (fr.nacks >= C.MAX_NACKS) return false;
+    const miss = [];
+    for (let i = 0; i < fr.total && miss.length < 512; i++) if (!fr.parts[i]) miss.push(i);
+    if (!sendMsg(mkBuf(10 + miss.length * 2, v => {
+        v.setUint32(0, MSG.NACK, true); v.setUint32(4, id, true); v.setUint16(8, miss.length, true);
+        miss.forEach((m, i) => v.setUint16(10 + i * 2, m, true));
+    }))) return false;
+    fr.nacks = (fr.nacks || 0) + 1;
+    fr.nackAt = rt;
+    S.pendingKey = id;
+    return true;
+};
+
+const dropHeld = () => { S.stats.tDropNet += S.held.length; S.held = []; S.pendingKey = null; };
+
+// Wire loss before FEC, so the server can size parity groups
+const countChunks = fr => { S.stats.tChunks += fr.total; S.stats.tChunkLost += fr.total - fr.raw; };
+
+// XOR parity rebuilds one missing data chunk per group; the first two parity bytes are the XOR of chunk lengths
+const recoverGroup = (fr, g) => {
+    const par = fr.parity[g];
+    if (!fr.fec || !par || par.byteLength < 2) return;
+    const lo = g * fr.fec, hi = Math.min(lo + fr.fec, fr.total);
+    let miss = -1;
+    for (let i = lo; i < hi; i++) if (!fr.parts[i]) { if (miss >= 0) return; miss = i; }
+    if (miss < 0) return;
+
+    const out = par.slice(2);
+    let len = par[0] | (par[1] << 8);
+    for (let i = lo; i < hi; i++) {
+        if (i === miss) continue;
+        const p = fr.parts[i];
+        len ^= p.byteLength;
+        for (let j = 0; j < p.byteLength; j++) out[j] ^= p[j];
+    }
+    if (len > out.byteLength) return;
+    fr.parts[miss] = out.subarray(0, len);
+    fr.received++;
+    S.stats.tFecRec++;
+};
+
 const tryDrop = (id, fr, rt) => {
     if (fr.received === fr.total) processFrame(id, fr, rt);
-    else { S.chunks.delete(id); S.stats.tDropNet++; if (fr.isKey) { S.needKey = true; reqKey(); } }
+    else if (fr.isKey && sendNack(id, fr, rt)) return;
+    else { countChunks(fr); S.chunks.delete(id); S.stats.tDropNet++; if (fr.isKey) { dropHeld(); S.needKey = true; reqKey(); } else sendFrameLoss(id); }
 };
 
 const processFrame = (fid, fr, rt) => {
     const ct = performance.now();
     if (!fr.parts.every(p => p)) { S.chunks.delete(fid); S.stats.tDropNet++; return; }
 
+    countChunks(fr);
     const buf = fr.total === 1 ? fr.parts[0] : fr.parts.reduce((a, p) => { a.set(p, a.off); a.off += p.byteLength; return a; }, Object.assign(new Uint8Array(fr.parts.reduce((s, p) => s + p.byteLength, 0)), { off: 0 }));
 
     S.stats.recv++;
@@ -182,10 +306,22 @@ const processFrame = (fid, fr, rt) => {
     updJitter(ct, fr.capTs, S.lastProcessedCapTs || 0);
     S.lastProcessedCapTs = fr.capTs;
 
-    const data = { buf, capTs: fr.capTs, encMs: fr.encMs, netMs, isKey: fr.isKey, fcT: ct, fId: fid };
+    const data = { buf, capTs: fr.capTs, encMs: fr.encMs, netMs, isKey: fr.isKey, fcT: ct, rcvT: fr.firstTime, fId: fid };
+
+    // Deltas after a keyframe that is still being repaired would decode against the wrong reference
+    if (fr.isKey && S.pendingKey !== null) {
+        if (fid === S.pendingKey) { const held = S.held; S.held = []; S.pendingKey = null; data.held = held; }
+        else { S.chunks.delete(S.pendingKey); dropHeld(); }
+    } else if (S.pendingKey !== null) {
+        S.held.push(data);
+        if (S.held.length > C.MAX_HELD) { dropHeld(); S.needKey = true; reqKey(); }
+        S.chunks.delete(fid);
+        return;
+    }
 
     const onFrame = () => {
         decodeFrame(data);
+        data.held?.forEach(decodeFrame);
         if (waitFirstFrame && isLoadingVisible()) { waitFirstFrame = false; hideLoading(); hasConnected = true; }
     };
 
@@ -195,6 +331,31 @@ const processFrame = (fid, fr, rt) => {
     S.chunks.delete(fid);
 };
 
+// Position arrives far more often than shapes; an unknown shape is asked for by hash, at most every CURSOR_REQ_MS
+const handleCursorPos = v => {
+    const k = S.cursor, now = performance.now();
+    k.x = v.getFloat32(4, true); k.y = v.getFloat32(8, true); k.shape = v.getUint32(12, true); k.visible = v.getUint8(16) === 1;
+    if (k.visible && !k.shapes.has(k.shape) && now - k.reqAt > C.CURSOR_REQ_MS &&
+        sendMsg(mkBuf(8, b => { b.setUint32(0, MSG.CURSOR_REQUEST, true); b.setUint32(4, k.shape, true); }), 'control')) k.reqAt = now;
+    drawCursor();
+};
+
+// Compact chunk header: type, frameType, stream, fecGroup bytes, then varint frameId, chunkIndex, totalChunks,
+// zigzag timestamp minus the HOST_INFO epoch and encodeTimeUs. Plain arithmetic: the timestamp outgrows 32-bit ops.
+const readChunkHdr = u8 => {
+    if (u8.length < 4 || u8[0] !== WIRE.VIDEO) return null;
+    const f = [];
+    let o = 4;
+    for (let i = 0; i < 5; i++) {
+        let x = 0, m = 1, b;
+        do { if (o >= u8.length || m > 2 ** 56) return null; b = u8[o++]; x += (b & 0x7F) * m; m *= 128; } while (b & 0x80);
+        f.push(x);
+    }
+    const zz = f[3], ts = zz % 2 ? -(zz + 1) / 2 : zz / 2;
+    return { typ: u8[1], strm: u8[2], fec: u8[3], fid: f[0], cidx: f[1], tot: f[2], cap: S.epoch + ts, enc: f[4], len: o };
+};
+
+// hpp/loopback.hpp ports this reassembly for SlipStreamBench --loopback; keep them matching
 const handleMsg = e => {
     const rt = performance.now();
     if (!(e.data instanceof ArrayBuffer) || e.data.byteLength < 4) return;
@@ -213,10 +374,14 @@ const handleMsg = e => {
         return;
     }
 
-    if (mg === MSG.HOST_INFO && len === 6) {
+    if (mg === MSG.HOST_INFO && len >= 16) {
         S.hostFps = v.getUint16(4, true);
+        const depth = v.getUint8(6);
+        if (v.getUint8(7) !== WIRE.VERSION) console.warn(`Host speaks wire version ${v.getUint8(7)}, expected ${WIRE.VERSION}`);
+        S.epoch = Number(v.getBigInt64(8, true));
+        if (depth !== S.bitDepth) { S.bitDepth = depth; if (S.decoder) initDecoder(); }
         updateFpsOpts();
-        if (!S.fpsSent) setTimeout(() => applyFps(selDefFps()), 50);
+        if (!S.fpsSent) setTimeout(() => { applyFps(selDefFps()); sendAudioCfg(); }, 50);
         if (isLoadingVisible()) { updateLoadingStage(Stage.STREAM); waitFirstFrame = true; }
         return;
     }
@@ -224,22 +389,35 @@ const handleMsg = e => {
     if (mg === MSG.FPS_ACK && len === 7) { S.currentFps = v.getUint16(4, true); S.currentFpsMode = v.getUint8(6); return; }
     if (mg === MSG.MONITOR_LIST && len >= 6) return parseMonList(e.data);
     if (mg === MSG.AUDIO_DATA && len >= 16) return handleAudioPkt(e.data);
-    if (len < C.HEADER) return;
+    if (mg === MSG.CURSOR_POS && len === 17) return handleCursorPos(v);
+    if (mg === MSG.CURSOR_SHAPE && len >= 16) {
+        const w = v.getUint16(8, true), h = v.getUint16(10, true);
+        if (len === 16 + w * h * 4) setCursorShape(v.getUint32(4, true), w, h, v.getUint16(12, true), v.getUint16(14, true), new Uint8Array(e.data, 16));
+        return;
+    }
+    const hdr = readChunkHdr(new Uint8Array(e.data));
+    if (!hdr) return;
 
     S.stats.bytes += len;
     S.stats.tBytes += len;
 
-    const cap = Number(v.getBigUint64(0, true)), enc = v.getUint32(8, true), fid = v.getUint32(12, true);
-    const cidx = v.getUint16(16, true), tot = v.getUint16(18, true), typ = v.getUint8(20);
-    const chunk = new Uint8Array(e.data, C.HEADER);
+    const { typ, strm, fec, fid, cidx, tot, cap, enc } = hdr;
+    const chunk = new Uint8Array(e.data, hdr.len);
+
+    if (S.lastFrameId > 0 && !isNewer(fid, S.lastFrameId) && fid !== S.lastFrameId && fid !== S.pendingKey) return;
 
-    if (S.lastFrameId > 0 && !isNewer(fid, S.lastFrameId) && fid !== S.lastFrameId) return;
+    // After a monitor switch the new stream starts at its keyframe and the old monitor's partial frames are dropped
+    if (strm !== S.stream) {
+        if (!(typ & 1) || (S.lastFrameId > 0 && !isNewer(fid, S.lastFrameId))) return;
+        S.stream = strm;
+        for (const id of [...S.chunks.keys()]) if (id !== fid && !isNewer(id, fid)) S.chunks.delete(id);
+    }
 
     for (const [id, fr] of S.chunks) if (fr.received < fr.total && rt - fr.firstTime > C.FRAME_TIMEOUT_MS) tryDrop(id, fr, rt);
 
     if (!S.chunks.has(fid)) {
         for (const [id, fr] of S.chunks) if (isNewer(fid, id) && fr.received < fr.total) tryDrop(id, fr, rt);
-        S.chunks.set(fid, { parts: Array(tot).fill(null), total: tot, received: 0, capTs: cap, encMs: enc / 1000, firstTime: rt, isKey: typ === 1 });
+        S.chunks.set(fid, { parts: Array(tot).fill(null), parity: [], fec, total: tot, received: 0, raw: 0, capTs: cap, encMs: enc / 1000, firstTime: rt, isKey: (typ & 1) === 1 });
 
         if (S.chunks.size > C.MAX_FRAMES) {
             let did = null, dage = 0;
@@ -250,37 +428,55 @@ const handleMsg = e => {
     }
 
     const fr = S.chunks.get(fid);
-    if (!fr || fr.parts[cidx]) return;
-    fr.parts[cidx] = chunk;
-    fr.received++;
+    if (!fr) return;
+    if (typ & 0x80) {
+        if (fr.parity[cidx] || fr.received === fr.total) return;
+        fr.parity[cidx] = chunk;
+        recoverGroup(fr, cidx);
+    } else {
+        if (fr.parts[cidx]) return;
+        fr.parts[cidx] = chunk;
+        fr.received++;
+        if (!(typ & 0x40)) fr.raw++;
+        if (fr.fec) recoverGroup(fr, Math.floor(cidx / fr.fec));
+    }
     if (fr.received === fr.total) processFrame(fid, fr, rt);
 };
 
-const setupDC = () => {
-    S.dc.binaryType = 'arraybuffer';
-
-    S.dc.onopen = async () => {
-        S.fpsSent = S.authenticated = false;
-        updateLoadingStage(Stage.AUTH);
-        console.info('Data channel opened');
+// Auth waits for every channel: its answer and the host info come back on the control one
+const onChannelsOpen = async () => {
+    S.fpsSent = S.authenticated = false;
+    updateLoadingStage(Stage.AUTH);
+    console.info('Data channels opened');
 
-        if (!validCreds(creds)) { const s = getSaved(); if (validCreds(s)) creds = s; }
-        if (validCreds(creds)) sendAuth(creds.username, creds.pin);
-        else showAuthModal();
+    if (!validCreds(creds)) { const s = getSaved(); if (validCreds(s)) creds = s; }
+    if (validCreds(creds)) sendAuth(creds.username, creds.pin);
+    else showAuthModal();
 
-        await initDecoder();
-        clearPing();
-        pingInterval = setInterval(() => { if (S.dc?.readyState === 'open') S.dc.send(mkBuf(16, v => { v.setUint32(0, MSG.PING, true); v.setBigUint64(8, BigInt(tsUs()), true); })); }, C.PING_MS);
-    };
+    await initDecoder();
+    clearPing();
+    S.lossRef = { recv: S.stats.tRecv, drop: S.stats.tDropNet };
+    pingInterval = setInterval(() => { sendMsg(mkBuf(16, v => { v.setUint32(0, MSG.PING, true); v.setUint32(4, Math.round(S.rtt * 1000), true); v.setBigUint64(8, BigInt(tsUs()), true); })); }, C.PING_MS);
+    reportInterval = setInterval(() => { if (S.authenticated) { if (S.rtp) sendRtpNetReport(); else sendNetReport(); sendTraceReport(); sendPresentReport(); } }, C.REPORT_MS);
+};
 
+const setupDC = () => {
+    const chans = Object.values(S.chans);
+    let opened = 0;
+    for (const ch of chans) {
+        ch.binaryType = 'arraybuffer';
+        ch.onopen = () => { if (++opened === chans.length) onChannelsOpen(); };
+        ch.onerror = e => console.error(`DataChannel ${ch.label}:`, e);
+        ch.onmessage = handleMsg;
+    }
     S.dc.onclose = () => { S.fpsSent = S.authenticated = false; clearPing(); };
-    S.dc.onerror = e => console.error('DataChannel:', e);
-    S.dc.onmessage = handleMsg;
 };
 
+const closeChannels = () => { Object.values(S.chans).forEach(ch => ch.close()); S.chans = {}; };
+
 const resetState = () => {
     clearPing();
-    S.dc?.close();
+    closeChannels();
     S.pc?.close();
     try { if (S.decoder?.state !== 'closed') S.decoder?.close(); } catch {}
     S.dc = S.pc = S.decoder = null;
@@ -288,8 +484,12 @@ const resetState = () => {
     S.jitter.last = 0;
     S.jitter.deltas = [];
     waitFirstFrame = false;
+    S.rtp = false;
+    rtpRef = null;
     S.chunks.clear();
-    S.lastFrameId = 0;
+    S.lastFrameId = S.lastGoodFid = 0;
+    S.pendingKey = null;
+    S.held = [];
     S.lastProcessedCapTs = 0;
     S.frameMeta.clear();
 };
@@ -382,9 +582,20 @@ const connect = async () => {
             if (e.errorCode !== 701) console.error('ICE error:', e.errorCode, e.errorText);
         };
 
-        S.dc = pc.createDataChannel('screen', C.DC);
+        S.chans = Object.fromEntries(Object.entries(C.CHANNELS).map(([label, opts]) => [label, pc.createDataChannel(label, opts)]));
+        S.dc = S.chans.screen;
         setupDC();
 
+        // RTP tracks only offer AV1, and need MediaStreamTrackProcessor to reach the renderer; otherwise chunks it is
+        const av1 = (RTCRtpReceiver.getCapabilities?.('video')?.codecs || []).filter(c => c.mimeType.toLowerCase() === 'video/av1');
+        const wantRtp = S.transport === 'rtp' && !!window.MediaStreamTrackProcessor && av1.length > 0;
+        if (wantRtp) {
+            const vt = pc.addTransceiver('video', { direction: 'recvonly' });
+            try { vt.setCodecPreferences(av1); } catch {}
+            pc.addTransceiver('audio', { direction: 'recvonly' });
+            pc.ontrack = e => attachRtpTrack(e, () => { if (waitFirstFrame && isLoadingVisible()) { waitFirstFrame = false; hideLoading(); hasConnected = true; } });
+        } else if (S.transport === 'rtp') console.warn('RTP transport unsupported here, using DataChannel chunks');
+
         // Create offer immediately
         const offer = await pc.createOffer();
         await pc.setLocalDescription(offer);
@@ -447,14 +658,16 @@ const connect = async () => {
             headers: { 'Content-Type': 'application/json' },
             body: JSON.stringify({
                 sdp: pc.localDescription.sdp,
-                type: pc.localDescription.type
+                type: pc.localDescription.type,
+                transport: wantRtp ? 'rtp' : 'datachannel'
             })
         });
 
         if (!res.ok) throw new Error('Server rejected offer');
 
         const ans = await res.json();
-        console.info('Received answer');
+        S.rtp = ans.transport === 'rtp';
+        console.info(`Received answer (${S.rtp ? 'RTP tracks' : 'DataChannel chunks'})`);
         updateLoadingStage(Stage.CONNECT);
         await pc.setRemoteDescription(new RTCSessionDescription(ans));
 
@@ -484,10 +697,10 @@ export const detectFps = async () => {
     });
 };
 
-export const cleanup = () => { clearPing(); S.dc?.close(); S.pc?.close(); };
+export const cleanup = () => { clearPing(); closeChannels(); S.pc?.close(); };
 
 (async () => {
-    setNetCbs(applyFps, sendMonSel);
+    setNetCbs(applyFps, sendMonSel, sendAudioCfg, setTransport);
     S.clientFps = await detectFps();
     updateFpsOpts();
     loadConnSettings();
@@ -4,12 +4,23 @@
  * @copyright 2025-2026 Daniel Chrobak
  */
 
-import { S } from './state.js';
+import { S, C } from './state.js';
 
 export const canvas = document.getElementById('c');
+const cur = document.getElementById('cur'), curCtx = cur?.getContext('2d');
+let curShown = 0;
 export let canvasW = 0;
 export let canvasH = 0;
 
+// Last rAF tick and the smoothed refresh period, reported to the host so it can time captures to this display
+const tickVsync = now => {
+    const v = S.vsync, d = now - v.t;
+    if (v.t && d > 0 && (!v.period || d < v.period * 1.5)) v.period = v.period ? v.period * 0.95 + d * 0.05 : d;
+    v.t = now;
+    requestAnimationFrame(tickVsync);
+};
+requestAnimationFrame(tickVsync);
+
 export const gl = canvas.getContext('webgl2', {
     alpha: false, depth: false, stencil: false, antialias: false,
     desynchronized: true, powerPreference: 'high-performance', preserveDrawingBuffer: false
@@ -138,12 +149,14 @@ export const render = (frame, meta) => {
         S.W = vW;
         S.H = vH;
         console.info(`Resolution: ${vW}x${vH}`);
-        if (was) S.needKey = true;
+        // A simulcast layer switch arrives as a keyframe at the new size and needs no further recovery
+        if (was && !meta?.isKey) S.needKey = true;
     }
 
     const vp = S.lastVp = calcVp(vW, vH, canvasW, canvasH);
     clear();
     applyVp(vp);
+    drawCursor();
 
     try {
         gl.texImage2D(gl.TEXTURE_2D, 0, gl.RGBA, gl.RGBA, gl.UNSIGNED_BYTE, frame);
@@ -158,6 +171,8 @@ export const render = (frame, meta) => {
             addLat(k, [t1 - meta.decStart, performance.now() - t1, meta.encMs, meta.netMs, meta.queueMs][i]);
         });
         S.frameMeta.delete(meta.capTs);
+        if (meta.rcvT && S.trace.length < C.TRACE_MAX) S.trace.push({ cap: meta.capTs, rcv: meta.rcvT, dec: t1, pres: performance.now() });
+        if (S.present.dec.length < C.TRACE_MAX) S.present.dec.push([meta.capTs, t1]);
     }
 
     S.stats.rend++;
@@ -168,10 +183,39 @@ export const render = (frame, meta) => {
 export const renderZoomed = () => {
     if (gl && S.W > 0 && S.H > 0) {
         updateSize();
-        draw(calcVp(S.W, S.H, canvasW, canvasH));
+        draw(S.lastVp = calcVp(S.W, S.H, canvasW, canvasH));
+        drawCursor();
     }
 };
 
+// Shapes are cached by hash, so a cursor seen once is never sent again
+export const setCursorShape = (hash, w, h, hx, hy, px) => {
+    const k = S.cursor;
+    k.shapes.set(hash, { w, h, hx, hy, img: new ImageData(new Uint8ClampedArray(px), w, h) });
+    if (k.shapes.size > C.MAX_CURSORS) k.shapes.delete(k.shapes.keys().next().value);
+    if (hash === k.shape) { curShown = 0; drawCursor(); }
+};
+
+// Host cursor on the overlay canvas, placed through the same viewport and zoom transform as the video
+export const drawCursor = () => {
+    if (!cur) return;
+    const k = S.cursor, sh = k.visible && S.W > 0 && k.shapes.get(k.shape);
+    if (!sh) { cur.style.display = 'none'; return; }
+    if (curShown !== k.shape) { cur.width = sh.w; cur.height = sh.h; curCtx.putImageData(sh.img, 0, 0); curShown = k.shape; }
+
+    const dpr = devicePixelRatio || 1, vp = S.lastVp, z = Math.max(S.zoom, 1);
+    const x = (z > 1 ? vp.x - S.zoomX * vp.w * z : vp.x) / dpr;
+    const y = (canvasH - (z > 1 ? vp.y + (S.zoomY * z - (z - 1)) * vp.h : vp.y) - vp.h * z) / dpr;
+    const w = vp.w * z / dpr, h = vp.h * z / dpr;
+    // Cursor pixels are host pixels, which only match the video size on the full-size layer
+    const srcW = S.monitors.find(m => m.index === S.currentMon)?.width || S.W, sc = w / srcW;
+
+    cur.style.display = 'block';
+    cur.style.width = `${sh.w * sc}px`;
+    cur.style.height = `${sh.h * sc}px`;
+    cur.style.transform = `translate(${x + k.x * w - sh.hx * sc}px, ${y + k.y * h - sh.hy * sc}px)`;
+};
+
 const stats = a => a.length ? { avg: a.reduce((x, y) => x + y, 0) / a.length, min: Math.min(...a), max: Math.max(...a) } : { avg: 0 };
 export const getLatStats = n => stats(S.lat[n]);
 
@@ -182,7 +226,7 @@ export const getJitterStats = () => {
 
 const onResize = () => {
     updateSize();
-    if (S.W > 0 && S.H > 0 && gl) draw(calcVp(S.W, S.H, canvasW, canvasH));
+    if (S.W > 0 && S.H > 0 && gl) { draw(S.lastVp = calcVp(S.W, S.H, canvasW, canvasH)); drawCursor(); }
 };
 
 let rto;
@@ -8,14 +8,32 @@ export const MSG = {
     PING: 0x504E4750, FPS_SET: 0x46505343, HOST_INFO: 0x484F5354, FPS_ACK: 0x46505341,
     REQUEST_KEY: 0x4B455952, MONITOR_LIST: 0x4D4F4E4C, MONITOR_SET: 0x4D4F4E53,
     AUDIO_DATA: 0x41554449, MOUSE_MOVE: 0x4D4F5645, MOUSE_BTN: 0x4D42544E,
-    MOUSE_WHEEL: 0x4D57484C, KEY: 0x4B455920, AUTH_REQUEST: 0x41555448, AUTH_RESPONSE: 0x41555452
+    MOUSE_WHEEL: 0x4D57484C, MOUSE_REL: 0x4D52454C, KEY: 0x4B455920, AUTH_REQUEST: 0x41555448, AUTH_RESPONSE: 0x41555452,
+    NET_REPORT: 0x4E455452, NACK: 0x4E41434B, FRAME_LOSS: 0x464C4F53, TRACE_REPORT: 0x54524345,
+    CURSOR_POS: 0x43504F53, CURSOR_SHAPE: 0x43534850, CURSOR_REQUEST: 0x43524551,
+    PRESENT_REPORT: 0x50524553, AUDIO_CONFIG: 0x41434647
 };
 
+// Compact records lead with a type byte below 0x20 instead of a magic; see hpp/protocol.hpp
+export const WIRE = { VERSION: 1, VIDEO: 0x01, BATCH: 0x02 };
+
 export const C = {
-    HEADER: 21, AUDIO_HEADER: 16, PING_MS: 200, CODEC: 'av01.0.05M.08',
-    MAX_FRAMES: 6, FRAME_TIMEOUT_MS: 100, AUDIO_RATE: 48000, AUDIO_CH: 2, AUDIO_BUF: 0.04,
-    DC: { ordered: false, maxRetransmits: 0 },
-    TOUCH_SENS: 0.5, TAP_MS: 200, TAP_THRESH: 10, LONG_MS: 400, MIN_ZOOM: 1, MAX_ZOOM: 5, PINCH_SENS: 0.01
+    AUDIO_HEADER: 16, PING_MS: 200, REPORT_MS: 1000, CODEC: 'av01.0.05M.08', CODEC_10: 'av01.0.05M.10',
+    MAX_FRAMES: 6, FRAME_TIMEOUT_MS: 100, MAX_NACKS: 2, NACK_MIN_MS: 30, MAX_HELD: 30, LOSS_MIN_MS: 50, TRACE_MAX: 64, CURSOR_REQ_MS: 250, MAX_CURSORS: 64, AUDIO_RATE: 48000, AUDIO_CH: 2, AUDIO_BUF: 0.04,
+    // One channel per traffic class: video and audio unreliable, control reliable and ordered, input ordered but
+    // given up after a while. The host sends each class on its own and falls back to screen for a missing one.
+    CHANNELS: {
+        screen: { ordered: false, maxRetransmits: 0 }, control: { ordered: true },
+        input: { ordered: true, maxPacketLifeTime: 250 }, audio: { ordered: false, maxRetransmits: 0 }
+    },
+    TOUCH_SENS: 0.5, TAP_MS: 200, TAP_THRESH: 10, LONG_MS: 400, MIN_ZOOM: 1, MAX_ZOOM: 5, PINCH_SENS: 0.01,
+    // Opus frame length (us), bitrate (kbps) and FEC/DTX flags for the host's shared encoder; the controller's pick applies
+    AUDIO_PROFILES: {
+        low: { frameUs: 5000, kbps: 128, fec: false, dtx: false },
+        bal: { frameUs: 10000, kbps: 128, fec: false, dtx: false },
+        std: { frameUs: 20000, kbps: 128, fec: false, dtx: false },
+        save: { frameUs: 20000, kbps: 48, fec: true, dtx: true }
+    }
 };
 
 export const Stage = {
@@ -24,25 +42,31 @@ export const Stage = {
 };
 
 export const S = {
-    pc: null, dc: null, decoder: null,
+    pc: null, dc: null, chans: {}, decoder: null,
     ready: false, needKey: true, reinit: false, hwAccel: 'unknown',
     lastCapTs: 0, W: 0, H: 0, rtt: 0, clockOff: 0, clockSync: false, clockSamples: [],
-    hostFps: 60, clientFps: 60, currentFps: 60, currentFpsMode: 0,
+    hostFps: 60, bitDepth: 8, epoch: 0, clientFps: 60, currentFps: 60, currentFpsMode: 0,
     fpsSent: false, authenticated: false, monitors: [], currentMon: 0,
-    audioCtx: null, audioEnabled: false, audioDecoder: null, audioGain: null,
-    audioPlaying: false, audioNextTime: 0, controlEnabled: false,
+    audioCtx: null, audioEnabled: false, audioDecoder: null, audioGain: null, audioProfile: 'std',
+    // transport is the viewer's pick; rtp is whether the host answered with media tracks for it
+    transport: 'datachannel', rtp: false,
+    audioPlaying: false, audioNextTime: 0, controlEnabled: false, relMouse: false,
     lastVp: { x: 0, y: 0, w: 0, h: 0 },
     touchEnabled: false, touchMode: 'trackpad', touchX: 0.5, touchY: 0.5,
     zoom: 1, zoomX: 0, zoomY: 0, statsOn: false, consoleOn: false,
     stage: Stage.IDLE, isReconnecting: false, firstFrameReceived: false,
     stats: {
-        tRecv: 0, tDec: 0, tRend: 0, tDropNet: 0, tDropDec: 0, tBytes: 0, tAudio: 0,
+        tRecv: 0, tDec: 0, tRend: 0, tDropNet: 0, tDropDec: 0, tBytes: 0, tAudio: 0, tFecRec: 0, tChunks: 0, tChunkLost: 0,
         recv: 0, dec: 0, rend: 0, bytes: 0, audio: 0, moves: 0, clicks: 0, keys: 0,
         lastUpdate: performance.now()
     },
     lat: { encode: [], network: [], decode: [], queue: [], render: [] },
     jitter: { last: 0, deltas: [] },
-    chunks: new Map(), frameMeta: new Map(), lastFrameId: 0, lastProcessedCapTs: 0
+    chunks: new Map(), frameMeta: new Map(), lastFrameId: 0, lastGoodFid: 0, stream: -1, lastProcessedCapTs: 0,
+    lossRef: { recv: 0, drop: 0, chunks: 0, lost: 0 },
+    pendingKey: null, held: [], trace: [],
+    cursor: { x: 0, y: 0, shape: 0, visible: false, shapes: new Map(), reqAt: 0 },
+    vsync: { t: 0, period: 0 }, present: { dec: [], depth: 0, n: 0 }
 };
 
 export const resetStats = () => Object.assign(S.stats, {
@@ -57,3 +81,38 @@ export const mkBuf = (sz, fn) => {
     fn(new DataView(b));
     return b;
 };
+
+// Messages sent on a channel within one task leave together as a BATCH record (type, then varint length and bytes
+// of each), so a tap's move and clicks or a report tick's messages cost one send
+const outbox = new Map();
+const varintLen = n => n < 0x80 ? 1 : n < 0x4000 ? 2 : 3;
+const channelFor = label => S.chans[label]?.readyState === 'open' ? S.chans[label] : S.dc;
+
+const flushOutbox = label => {
+    const msgs = outbox.get(label), ch = channelFor(label);
+    outbox.delete(label);
+    if (ch?.readyState !== 'open') return;
+    let out = msgs[0];
+    if (msgs.length > 1) {
+        out = new Uint8Array(1 + msgs.reduce((n, m) => n + varintLen(m.length) + m.length, 0));
+        out[0] = WIRE.BATCH;
+        let o = 1;
+        for (const m of msgs) {
+            let n = m.length;
+            for (; n >= 0x80; n >>>= 7) out[o++] = (n & 0x7F) | 0x80;
+            out[o++] = n;
+            out.set(m, o);
+            o += m.length;
+        }
+    }
+    try { ch.send(out); } catch {}
+};
+
+// Timing reports, pings and loss feedback stay on the video channel: they describe it and are stale once late
+export const sendMsg = (buf, label = 'screen') => {
+    if (channelFor(label)?.readyState !== 'open') return false;
+    let q = outbox.get(label);
+    if (!q) { outbox.set(label, q = []); queueMicrotask(() => flushOutbox(label)); }
+    q.push(new Uint8Array(buf));
+    return true;
+};
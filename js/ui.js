@@ -6,7 +6,7 @@
 
 import { S, $, resetStats, Stage } from './state.js';
 import { getLatStats, getJitterStats } from './renderer.js';
-import { setTouchMode } from './input.js';
+import { setTouchMode, setRelMouse } from './input.js';
 import { toggleAudio } from './media.js';
 
 const loadingEl = $('loadingOverlay'), statusEl = $('loadingStatus'), subEl = $('loadingSubstatus');
@@ -83,8 +83,8 @@ window.onunhandledrejection = e => console.error('Promise:', e.reason);
 
 export const clearLogs = () => { conOut.innerHTML = ''; logCnt = 0; };
 
-let applyFpsFn = null, sendMonFn = null;
-export const setNetCbs = (f, m) => { applyFpsFn = f; sendMonFn = m; };
+let applyFpsFn = null, sendMonFn = null, sendAudioFn = null, transportFn = null;
+export const setNetCbs = (f, m, a, t) => { applyFpsFn = f; sendMonFn = m; sendAudioFn = a; transportFn = t; $('aProf').value = S.audioProfile; $('trSel').value = S.transport; };
 
 const pnl = $('pnl'), sc = $('sc'), statsEl = $('stats'), conEl = $('con'), fpsSel = $('fpsSel'), monSel = $('monSel');
 
@@ -103,10 +103,16 @@ const bindTog = (id, key, target) => {
 bindTog('togS', 'statsOn', statsEl);
 bindTog('togC', 'consoleOn', conEl);
 
+const togR = $('togR');
+togR.onclick = () => { setRelMouse(!S.relMouse); togR.classList.toggle('on', S.relMouse); };
+togR.onkeydown = e => { if (e.key === 'Enter' || e.key === ' ') { e.preventDefault(); togR.click(); } };
+
 $('conClr').onclick = clearLogs;
 fpsSel.onchange = () => applyFpsFn?.(fpsSel.value);
 monSel.onchange = () => sendMonFn?.(+monSel.value);
 $('aBtn').onclick = toggleAudio;
+$('aProf').onchange = e => sendAudioFn?.(e.target.value);
+$('trSel').onchange = e => transportFn?.(e.target.value);
 
 document.querySelectorAll('input[name="tm"]').forEach(r => r.addEventListener('change', e => { if (e.target.checked) setTouchMode(e.target.value); }));
 
@@ -157,19 +163,19 @@ export const updateStats = () => {
 
     const [enc, net, dec, , ren] = ['encode', 'network', 'decode', 'queue', 'render'].map(getLatStats);
     const jit = getJitterStats();
-    const { recv, dec: dS, rend, bytes, audio, moves, clicks, keys, tRecv, tDropNet, tDropDec } = S.stats;
+    const { recv, dec: dS, rend, bytes, audio, moves, clicks, keys, tRecv, tDropNet, tDropDec, tFecRec } = S.stats;
     const [inF, decF, rndF, br, aud] = [recv / dt, dS / dt, rend / dt, (bytes * 8) / 1048576 / dt, audio / dt];
     const tDrop = tDropNet + tDropDec, tFr = tRecv + tDrop, dropP = tFr > 0 ? (tDrop / tFr) * 100 : 0;
     const mode = S.currentFpsMode === 1 ? ' (H)' : S.currentFpsMode === 2 ? ' (C)' : '';
 
     sc.innerHTML = [
-        sec('Stream', row('Monitor', S.monitors.length ? `#${S.currentMon + 1}` : '-'), row('Res', `${S.W}x${S.H}`), row('Codec', `AV1 ${S.hwAccel}`), row('FPS', `${S.currentFps}${mode}`), row('Bitrate', `${fn(br, 1)} Mbps`)),
+        sec('Stream', row('Monitor', S.monitors.length ? `#${S.currentMon + 1}` : '-'), row('Res', `${S.W}x${S.H}`), row('Codec', `AV1 ${S.bitDepth}-bit ${S.hwAccel}`), row('FPS', `${S.currentFps}${mode}`), row('Bitrate', `${fn(br, 1)} Mbps`)),
         sec('FPS', row('In', fn(inF, 1)), row('Decode', fn(decF, 1)), row('Render', fn(rndF, 1))),
         sec('Audio', row('Status', S.audioEnabled ? 'On' : 'Off', S.audioEnabled ? 'g' : ''), row('Pkt/s', fn(aud, 1))),
         sec('Input', row('Status', S.controlEnabled ? 'On' : 'Off', S.controlEnabled ? 'g' : ''), row('Mouse/s', fn(moves / dt, 0)), row('Click+Key', `${clicks}+${keys}`)),
         sec('Touch', row('Mode', S.touchEnabled ? S.touchMode : 'Off', S.touchEnabled ? 'g' : ''), row('Pos', `${fn(S.touchX)},${fn(S.touchY)}`), row('Zoom', `${fn(S.zoom)}x`)),
         sec('Latency', row('RTT', `${fn(S.rtt, 1)}ms`, clr(S.rtt, 20, 50)), row('Enc', `${fn(enc.avg, 1)}ms`), row('Net', `${fn(net.avg, 1)}ms`), row('Dec', `${fn(dec.avg)}ms`), row('Ren', `${fn(ren.avg)}ms`)),
-        sec('Quality', row('Jitter', `${fn(jit.avg)}ms`), row('Sync', S.clockSync ? 'Y' : 'N'), row('Recv', tRecv), row('Drop', `${tDrop} (${fp(tDrop, tFr)}%)`, clr(dropP, 1, 5)))
+        sec('Quality', row('Jitter', `${fn(jit.avg)}ms`), row('Sync', S.clockSync ? 'Y' : 'N'), row('Recv', tRecv), row('FEC', tFecRec), row('Drop', `${tDrop} (${fp(tDrop, tFr)}%)`, clr(dropP, 1, 5)))
     ].join('');
 
     resetStats();
@@ -10,6 +10,8 @@
 #include "webrtc.hpp"
 #include "audio.hpp"
 #include "input.hpp"
+#include "cursor.hpp"
+#include "metrics.hpp"
 
 std::vector<MonitorInfo> g_monitors;
 std::mutex g_monitorsMutex;
@@ -42,12 +44,34 @@ void RefreshMonitorList() {
     LOG("Found %zu monitor(s)", g_monitors.size());
 }
 
+// Everything one captured monitor needs; every pipeline keeps capturing, only the focused one encodes
+struct MonitorPipeline {
+    FrameSlot frameSlot;
+    std::unique_ptr<ScreenCapture> capture;
+    std::unique_ptr<AV1Encoder> encoder, lowEncoder;
+    std::mutex encoderMutex;
+    EncodedFrameRing<8> sendRing;
+    std::atomic<bool> encoderReady{false};
+    std::thread encodeThread, sendThread;
+    // Totals over every encoder this pipeline has run, under encoderMutex. A parked encoder's counts are banked and a
+    // warm one's earlier counts taken back out, so a swap never moves them backward. Wraps harmlessly in between.
+    uint64_t retiredEncoded = 0, retiredFailed = 0;
+    uint64_t Encoded() const { return retiredEncoded + (encoder ? encoder->GetEncoded() : 0); }
+    uint64_t Failed() const { return retiredFailed + (encoder ? encoder->GetFailed() : 0); }
+};
+
+constexpr size_t MAX_PIPELINES = 4;
+constexpr size_t WARM_ENCODERS = 1;
+
+// An encoder pair set aside with the capture pools it adopted, for a return to that size and rate
+struct WarmEncoders { std::unique_ptr<AV1Encoder> encoder, lowEncoder; };
+
 std::string LoadFile(const char* path) {
     std::ifstream f(path);
     return f.is_open() ? std::string(std::istreambuf_iterator<char>(f), {}) : "";
 }
 
-struct Config { std::string username, pin; } g_config;
+struct Config { std::string username, pin; int keyframeIntervalMs = 2000, intraRefreshFrames = 0; } g_config;
 
 bool LoadConfig() {
     try {
@@ -56,6 +80,7 @@ bool LoadConfig() {
         json c = json::parse(f);
         if (c.contains("username") && c.contains("pin")) {
             g_config.username = c["username"]; g_config.pin = c["pin"];
+            g_config.keyframeIntervalMs = c.value("keyframeIntervalMs", 2000); g_config.intraRefreshFrames = c.value("intraRefreshFrames", 0);
             return g_config.username.size() >= 3 && g_config.pin.size() == 6;
         }
     } catch (...) {}
@@ -63,7 +88,8 @@ bool LoadConfig() {
 }
 
 bool SaveConfig() {
-    try { std::ofstream("auth.json") << json{{"username", g_config.username}, {"pin", g_config.pin}}.dump(2); return true; }
+    try { std::ofstream("auth.json") << json{{"username", g_config.username}, {"pin", g_config.pin},
+        {"keyframeIntervalMs", g_config.keyframeIntervalMs}, {"intraRefreshFrames", g_config.intraRefreshFrames}}.dump(2); return true; }
     catch (...) { return false; }
 }
 
@@ -118,49 +144,146 @@ int main() {
         constexpr int PORT = 6060;
         SetPriorityClass(GetCurrentProcess(), ABOVE_NORMAL_PRIORITY_CLASS);
 
-        FrameSlot frameSlot;
         auto rtcServer = std::make_shared<WebRTCServer>();
         rtcServer->SetAuthCredentials(g_config.username, g_config.pin);
 
-        ScreenCapture capture(&frameSlot);
-        std::unique_ptr<AV1Encoder> encoder;
-        std::mutex encoderMutex;
-        std::atomic<bool> encoderReady{false}, running{true};
+        // The primary monitor's pipeline owns the D3D11 device; the other monitors share it
+        std::vector<std::unique_ptr<MonitorPipeline>> pipelines;
+        pipelines.push_back(std::make_unique<MonitorPipeline>());
+        pipelines[0]->capture = std::make_unique<ScreenCapture>(&pipelines[0]->frameSlot);
+        size_t monitorCount;
+        { std::lock_guard<std::mutex> lock(g_monitorsMutex); monitorCount = std::min(g_monitors.size(), MAX_PIPELINES); }
+        for (int i = 1; i < static_cast<int>(monitorCount); i++) {
+            auto p = std::make_unique<MonitorPipeline>();
+            try { p->capture = std::make_unique<ScreenCapture>(&p->frameSlot, *pipelines[0]->capture, i); pipelines.push_back(std::move(p)); }
+            catch (const std::exception& e) { WARN("Monitor %d: %s", i, e.what()); }
+        }
+        std::atomic<MonitorPipeline*> focused{pipelines[0].get()};
+        auto pipelineFor = [&](int idx) -> MonitorPipeline* {
+            for (auto& p : pipelines) if (p->capture->GetCurrentMonitorIndex() == idx) return p.get();
+            return nullptr;
+        };
+        auto total = [&](auto fn) { uint64_t n = 0; for (auto& p : pipelines) n += fn(*p); return n; };
+        std::atomic<bool> running{true};
+        std::atomic<uint64_t> staticCount{0};
 
         InputHandler inputHandler;
         inputHandler.Enable();
+        CursorTracker cursor;
 
         auto updateInputBounds = [&](int idx) {
             std::lock_guard<std::mutex> lock(g_monitorsMutex);
-            if (idx >= 0 && idx < static_cast<int>(g_monitors.size()))
+            if (idx >= 0 && idx < static_cast<int>(g_monitors.size())) {
                 inputHandler.UpdateFromMonitorInfo(g_monitors[idx]);
+                cursor.UpdateFromMonitorInfo(g_monitors[idx]);
+            }
         };
 
-        updateInputBounds(capture.GetCurrentMonitorIndex());
+        updateInputBounds(focused.load()->capture->GetCurrentMonitorIndex());
         rtcServer->SetInputHandler(&inputHandler);
+        cursor.SetCallback([&](const CursorPosMsg& pos, const CursorTracker::Shape& shape) { rtcServer->SendCursor(pos, shape); });
+        rtcServer->SetCursorShapeCallback([&](uint32_t hash) { return cursor.GetShape(hash); });
 
         std::unique_ptr<AudioCapture> audioCapture;
         try { audioCapture = std::make_unique<AudioCapture>(); } catch (...) {}
+        rtcServer->SetAudioConfigCallback([&](const AudioConfigMsg& c) {
+            if (audioCapture && !audioCapture->Configure(c.frameUs, c.kbps, c.flags & AUDIO_FEC, c.flags & AUDIO_DTX)) WARN("Audio config rejected: %uus frames", c.frameUs);
+        });
 
-        auto createEncoder = [&](int w, int h, int fps) {
-            std::lock_guard<std::mutex> lock(encoderMutex);
-            encoderReady = false; encoder.reset();
-            try { encoder = std::make_unique<AV1Encoder>(w, h, fps, capture.GetDev(), capture.GetCtx(), capture.GetMT()); encoderReady = true; LOG("Encoder: %dx%d @ %d FPS", w, h, fps); }
-            catch (const std::exception& e) { ERR("Encoder: %s", e.what()); }
+        // Intra refresh and the simulcast layer count describe the focused pipeline's encoders
+        auto applyFocus = [&](MonitorPipeline& p) {
+            rtcServer->SetIntraRefresh(p.encoder && p.encoder->UsesIntraRefresh());
+            rtcServer->SetLayerCount(p.lowEncoder ? 2 : 1);
+        };
+
+        // Backends are probed in preference order on the first open only; every later encoder goes straight to the winner
+        std::string backend;
+        std::mutex warmMutex;
+        std::deque<WarmEncoders> warm;
+        auto openEncoder = [&](ScreenCapture& capture, ID3D11Texture2D* pool, int w, int h, int fps, int layer) {
+            EncoderSettings settings{g_config.keyframeIntervalMs, g_config.intraRefreshFrames, backend};
+            auto open = [&] { return std::make_unique<AV1Encoder>(w, h, fps, capture.GetDev(), capture.GetCtx(), capture.GetMT(), capture.GetSync(), pool, capture.GetPoolSize(), rtcServer->GetTargetBitrate(layer), settings); };
+            // Warm sessions count against the driver's concurrent session limit, so they are the first thing given up
+            auto dropWarm = [&] { std::lock_guard<std::mutex> lock(warmMutex); bool any = !warm.empty(); warm.clear(); return any; };
+            if (!backend.empty()) { try { return open(); } catch (const std::exception&) { if (!dropWarm()) throw; return open(); } }
+            for (auto name : AV1Encoder::CODECS) {
+                if (!avcodec_find_encoder_by_name(name)) continue;
+                settings.codec = name;
+                try { auto e = open(); backend = name; return e; }
+                catch (const std::exception& e) { WARN("%s unavailable: %s", name, e.what()); }
+            }
+            throw std::runtime_error("No AV1 encoder could be opened");
+        };
+
+        auto createEncoder = [&](MonitorPipeline& p, int w, int h, int fps) {
+            std::lock_guard<std::mutex> lock(p.encoderMutex);
+            ScreenCapture& capture = *p.capture;
+            int mon = capture.GetCurrentMonitorIndex();
+            p.encoderReady = false;
+            WarmEncoders prev{std::move(p.encoder), std::move(p.lowEncoder)};
+            {
+                // The capture hands back the same pools for a size it has seen, so the pool identifies a reusable encoder
+                std::lock_guard<std::mutex> wl(warmMutex);
+                auto it = std::find_if(warm.begin(), warm.end(), [&](const WarmEncoders& e) {
+                    return e.encoder->GetPool() == capture.GetPool() && e.encoder->GetFPS() == fps &&
+                           (e.lowEncoder ? e.lowEncoder->GetPool() : nullptr) == capture.GetLowPool();
+                });
+                if (it != warm.end()) {
+                    p.encoder = std::move(it->encoder); p.lowEncoder = std::move(it->lowEncoder); warm.erase(it);
+                    p.retiredEncoded -= p.encoder->GetEncoded(); p.retiredFailed -= p.encoder->GetFailed();
+                }
+                if (prev.encoder) {
+                    prev.encoder->Flush(); if (prev.lowEncoder) prev.lowEncoder->Flush();
+                    p.retiredEncoded += prev.encoder->GetEncoded(); p.retiredFailed += prev.encoder->GetFailed();
+                    warm.push_front(std::move(prev));
+                    if (warm.size() > WARM_ENCODERS) warm.pop_back();
+                }
+            }
+            if (p.encoder) {
+                p.encoder->SetBitrate(rtcServer->GetTargetBitrate()); if (p.lowEncoder) p.lowEncoder->SetBitrate(rtcServer->GetTargetBitrate(1));
+                p.encoderReady = true; LOG("Encoder %d: %dx%d @ %d FPS (warm)", mon, w, h, fps);
+                // A fresh encoder opens on a keyframe by itself; a reused one has to be asked
+                if (focused == &p) { rtcServer->RequestKeyframe(0); rtcServer->RequestKeyframe(1); }
+            } else {
+                try { p.encoder = openEncoder(capture, capture.GetPool(), w, h, fps, 0); p.encoderReady = true; LOG("Encoder %d: %dx%d @ %d FPS", mon, w, h, fps); }
+                catch (const std::exception& e) { ERR("Encoder %d: %s", mon, e.what()); }
+                // The half-size simulcast rung needs a second hardware session; software encoders stay single-layer
+                if (p.encoder && p.encoder->IsHardware() && capture.GetLowPool()) {
+                    try { p.lowEncoder = openEncoder(capture, capture.GetLowPool(), capture.GetLowW(), capture.GetLowH(), fps, 1); LOG("Low layer %d: %dx%d", mon, capture.GetLowW(), capture.GetLowH()); }
+                    catch (const std::exception& e) { WARN("Low layer encoder %d: %s", mon, e.what()); }
+                }
+            }
+            // The encode loop turns the half-size convert on only while some viewer is on that rung
+            capture.SetLowLayerEnabled(false);
+            if (focused == &p) applyFocus(p);
         };
 
-        createEncoder(capture.GetW(), capture.GetH(), capture.GetHostFPS());
-        capture.SetResolutionChangeCallback([&](int w, int h, int fps) { createEncoder(w, h, fps); });
-        rtcServer->SetGetHostFpsCallback([&] { return capture.RefreshHostFPS(); });
-        rtcServer->SetAuthenticatedCallback([&] { std::thread([&] { std::this_thread::sleep_for(100ms); inputHandler.WiggleCenter(); }).detach(); });
-        rtcServer->SetFpsChangeCallback([&](int fps, uint8_t) { capture.SetFPS(fps); if (!capture.IsCapturing()) capture.StartCapture(); });
-        rtcServer->SetGetCurrentMonitorCallback([&] { return capture.GetCurrentMonitorIndex(); });
+        for (auto& p : pipelines) {
+            createEncoder(*p, p->capture->GetW(), p->capture->GetH(), p->capture->GetHostFPS());
+            p->capture->SetResolutionChangeCallback([&, p = p.get()](int w, int h, int fps) { createEncoder(*p, w, h, fps); });
+            p->capture->SetDeadlineCallback([&](int64_t deadline, int64_t interval) { return rtcServer->AlignCaptureDeadline(deadline, interval); });
+        }
+        rtcServer->SetGetHostFpsCallback([&] { return focused.load()->capture->RefreshHostFPS(); });
+        rtcServer->SetAuthenticatedCallback([&] { std::thread([&] { std::this_thread::sleep_for(100ms); focused.load()->capture->RepeatLastFrame(); }).detach(); });
+        rtcServer->SetFpsChangeCallback([&](int fps, uint8_t) {
+            cursor.SetFPS(fps);
+            for (auto& p : pipelines) { p->capture->SetFPS(fps); if (!p->capture->IsCapturing()) p->capture->StartCapture(); }
+        });
+        rtcServer->SetGetCurrentMonitorCallback([&] { return focused.load()->capture->GetCurrentMonitorIndex(); });
+        rtcServer->SetGetBitDepthCallback([&] { return focused.load()->capture->GetBitDepth(); });
+        // Other monitors are already captured and their encoders open, so switching only waits for one keyframe
         rtcServer->SetMonitorChangeCallback([&](int idx) {
-            bool ok = capture.SwitchMonitor(idx);
-            if (ok) { updateInputBounds(idx); std::thread([&] { std::this_thread::sleep_for(100ms); inputHandler.WiggleCenter(); }).detach(); }
-            return ok;
+            MonitorPipeline* p = pipelineFor(idx);
+            if (!p && !(p = focused)->capture->SwitchMonitor(idx)) return false;
+            rtcServer->SetFocusedStream(idx);
+            focused = p;
+            { std::lock_guard<std::mutex> lock(p->encoderMutex); applyFocus(*p); }
+            updateInputBounds(idx);
+            // Delayed past the pipeline's drain loop, which could otherwise swallow the repeat before noticing its focus
+            std::thread([p] { std::this_thread::sleep_for(100ms); p->capture->RepeatLastFrame(); }).detach();
+            return true;
         });
-        rtcServer->SetDisconnectCallback([&] { capture.PauseCapture(); });
+        rtcServer->SetDisconnectCallback([&] { for (auto& p : pipelines) p->capture->PauseCapture(); });
 
         httplib::Server httpServer;
         httpServer.set_post_routing_handler([](auto&, auto& r) {
@@ -181,76 +304,216 @@ int main() {
             try {
                 auto body = json::parse(req.body);
                 std::string offer = body["sdp"].get<std::string>();
-                LOG("Received offer from client");
-                rtcServer->SetRemote(offer, "offer");
-                std::string answer = rtcServer->GetLocal();
-                if (answer.empty()) { res.status = 500; res.set_content(R"({"error":"Failed to generate answer"})", "application/json"); return; }
-                if (size_t p = answer.find("a=setup:actpass"); p != std::string::npos) answer.replace(p, 15, "a=setup:active");
-                res.set_content(json{{"sdp", answer}, {"type", "answer"}}.dump(), "application/json");
+                bool rtp = body.value("transport", std::string("datachannel")) == "rtp";
+                LOG("Received offer from client (%s)", rtp ? "rtp" : "datachannel");
+                std::string answer = rtcServer->HandleOffer(offer, &rtp);
+                if (answer.empty()) { res.status = 503; res.set_content(R"({"error":"Server full or failed to generate answer"})", "application/json"); return; }
+                // Every m-section of the bundle (application, plus video and audio with RTP tracks) must take the same role
+                for (size_t p = 0; (p = answer.find("a=setup:actpass", p)) != std::string::npos; p += 14) answer.replace(p, 15, "a=setup:active");
+                res.set_content(json{{"sdp", answer}, {"type", "answer"}, {"transport", rtp ? "rtp" : "datachannel"}}.dump(), "application/json");
                 LOG("Sent answer to client");
             } catch (const std::exception& e) { ERR("Offer error: %s", e.what()); res.status = 400; res.set_content(R"({"error":"Invalid offer"})", "application/json"); }
         });
 
+        // Chrome trace JSON (load in chrome://tracing or Perfetto) and per-stage p50/p99 of the recent frames
+        httpServer.Get("/api/trace", [](auto&, auto& r) { r.set_content(Trace::ExportChrome(), "application/json"); });
+        httpServer.Get("/api/trace/stats", [](auto&, auto& r) { r.set_content(Trace::ExportStats(), "application/json"); });
+
+        auto encodedFrames = [](MonitorPipeline& p) { std::lock_guard<std::mutex> lock(p.encoderMutex); return p.Encoded(); };
+
+        // Prometheus text exposition; every counter is a total since start so scrapers compute their own rates
+        httpServer.Get("/metrics", [&](auto&, auto& r) {
+            MetricsWriter m;
+            auto stats = rtcServer->GetStats();
+            m.Counter("slipstream_frames_sent_total", "Video frames handed to viewers", stats.sent);
+            m.Counter("slipstream_bytes_sent_total", "Video payload bytes sent", stats.bytes);
+            m.Counter("slipstream_congestion_skips_total", "Frames not encoded because every viewer was congested", stats.skipped);
+            m.Counter("slipstream_send_drops_total", "Frames a session dropped while sending: buffer overflow, pacing backlog, failed send or waiting for a keyframe", stats.dropped);
+            m.Counter("slipstream_audio_packets_total", "Audio packets sent", rtcServer->GetAudioSent());
+            m.Counter("slipstream_audio_drops_total", "Encoded audio packets lost to a full send queue", audioCapture ? audioCapture->GetDroppedPackets() : 0);
+            m.Counter("slipstream_fec_parity_total", "FEC parity chunks sent", rtcServer->GetParitySent());
+            m.Counter("slipstream_retransmits_total", "Chunks resent on NACK", rtcServer->GetRetransmitted());
+            m.Counter("slipstream_loss_reports_total", "Frame loss reports received from viewers", rtcServer->GetLossReports());
+            m.Counter("slipstream_capture_drops_total", "Captured frames replaced before the encoder took them", total([](MonitorPipeline& p) { return p.frameSlot.GetDropped(); }));
+            m.Counter("slipstream_texture_conflicts_total", "Captured frames skipped because the encoder held every pool slice", total([](MonitorPipeline& p) { return p.capture->GetTexConflicts(); }));
+            m.Counter("slipstream_static_skips_total", "Frames skipped because nothing changed on screen", staticCount.load());
+            m.Counter("slipstream_encoded_frames_total", "Frames produced by the full-size encoders", total(encodedFrames));
+            m.Counter("slipstream_encode_failures_total", "Encode calls that failed on the full-size encoders", total([](MonitorPipeline& p) {
+                std::lock_guard<std::mutex> lock(p.encoderMutex); return p.Failed(); }));
+            m.Counter("slipstream_gpu_waits_total", "Capture fence waits", total([](MonitorPipeline& p) { return p.capture->GetSync()->GetWaits(); }));
+            m.Counter("slipstream_gpu_timeouts_total", "Capture fence waits that timed out", total([](MonitorPipeline& p) { return p.capture->GetSync()->GetTimeouts(); }));
+            auto in = inputHandler.GetStats();
+            m.Counter("slipstream_input_events_total", "Input events injected", "type", {{"move", in.moves}, {"click", in.clicks}, {"key", in.keys}});
+            m.Counter("slipstream_input_batches_total", "SendInput calls injecting queued events", in.batches);
+            m.Gauge("slipstream_peers", "Viewers currently streaming", rtcServer->GetPeerCount());
+            m.Gauge("slipstream_target_bitrate_bps", "Bitrate the full-size encoder is running at", static_cast<double>(rtcServer->GetTargetBitrate()));
+            m.Gauge("slipstream_capture_fps", "Capture rate requested by the controlling viewer", focused.load()->capture->GetCurrentFPS());
+            m.Gauge("slipstream_host_fps", "Refresh rate of the focused monitor", focused.load()->capture->GetHostFPS());
+            m.Gauge("slipstream_monitor_pipelines", "Monitors captured at once", static_cast<double>(pipelines.size()));
+            m.Histogram("slipstream_encode_seconds", "Time from encoder submit to packet out", g_encodeLatency);
+            m.Histogram("slipstream_send_seconds", "Time from capture to the last chunk of a frame leaving", g_sendLatency);
+            m.Histogram("slipstream_gpu_wait_seconds", "Time spent waiting on the capture fence", g_gpuWaitLatency);
+            r.set_content(m.Text(), "text/plain; version=0.0.4");
+        });
+
         std::thread serverThread([&] { httpServer.listen("0.0.0.0", PORT); });
         std::this_thread::sleep_for(100ms);
 
         printf("\n\033[1;36m==========================================\033[0m\n");
         printf("\033[1;36m            SLIPSTREAM SERVER             \033[0m\n");
         printf("\033[1;36m==========================================\033[0m\n\n");
-        printf("  \033[1mLocal:\033[0m  http://localhost:%d\n\n  User: %s | Display: %dHz\n", PORT, g_config.username.c_str(), capture.GetHostFPS());
+        printf("  \033[1mLocal:\033[0m  http://localhost:%d\n\n  User: %s | Display: %dHz\n", PORT, g_config.username.c_str(), focused.load()->capture->GetHostFPS());
         printf("\033[1;36m==========================================\033[0m\n\n");
 
         if (audioCapture) audioCapture->Start();
+        cursor.Start();
 
         std::thread audioThread([&] {
             if (!audioCapture) return;
             SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
-            AudioPacket pkt;
             while (running) {
-                if (!rtcServer->IsConnected() || !rtcServer->IsAuthenticated() || !rtcServer->IsFpsReceived()) { std::this_thread::sleep_for(10ms); continue; }
-                if (audioCapture->PopPacket(pkt, 5)) rtcServer->SendAudio(pkt.data, pkt.ts, pkt.samples);
+                // Packets nobody is listening to are let go, so a new viewer starts on live audio
+                bool live = rtcServer->IsConnected() && rtcServer->IsAuthenticated() && rtcServer->IsFpsReceived();
+                const AudioPacket* pkt = audioCapture->PeekPacket(live ? 5 : 10);
+                if (!pkt) { if (live) rtcServer->FlushAudio(); continue; }
+                if (live) rtcServer->SendAudio(pkt->data, pkt->size, pkt->ts, pkt->samples);
+                audioCapture->ReleasePacket();
             }
         });
 
         std::thread statsThread([&] {
             SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
             uint64_t hist[10] = {}; int idx = 0;
+            CounterDelta dSent, dBytes, dAudio, dStatic, dParity, dRtx, dLoss, dEnc, dRb, dRbUs, dStalls, dWaits, dWaitUs, dTimeouts;
             while (running) {
                 std::this_thread::sleep_for(1s);
                 auto stats = rtcServer->GetStats();
-                uint64_t enc = 0;
-                { std::lock_guard<std::mutex> lock(encoderMutex); if (encoder) enc = encoder->GetEncoded(); }
+                uint64_t enc = dEnc(total(encodedFrames));
+                char readback[40] = "";
+                MonitorPipeline& fp = *focused.load();
+                {
+                    std::lock_guard<std::mutex> lock(fp.encoderMutex);
+                    if (auto* encoder = fp.encoder.get()) {
+                        uint64_t rb = dRb(encoder->GetReadbacks()), rbUs = dRbUs(encoder->GetReadbackUs()), stalls = dStalls(encoder->GetReadbackStalls());
+                        if (!encoder->IsHardware()) snprintf(readback, sizeof(readback), " | RB: %4.0fus/%llu", rb ? static_cast<double>(rbUs) / rb : 0.0, stalls);
+                    }
+                }
                 hist[idx++ % 10] = enc;
                 int cnt = std::min(idx, 10);
                 uint64_t sum = 0; for (int i = 0; i < cnt; i++) sum += hist[i];
                 const char* st = stats.connected ? (rtcServer->IsAuthenticated() ? (rtcServer->IsFpsReceived() ? "\033[32m[LIVE]\033[0m" : "\033[33m[WAIT]\033[0m") : "\033[33m[AUTH]\033[0m") : "\033[33m[WAIT]\033[0m";
-                printf("%s FPS: %3llu @ %d | %5.2f Mbps | V:%4llu A:%3llu | Avg: %.1f\n", st, enc, capture.GetCurrentFPS(), stats.bytes * 8.0 / 1048576.0, stats.sent, rtcServer->GetAudioSent(), cnt > 0 ? static_cast<double>(sum) / cnt : 0.0);
+                uint64_t waits = dWaits(total([](MonitorPipeline& p) { return p.capture->GetSync()->GetWaits(); }));
+                uint64_t waitUs = dWaitUs(total([](MonitorPipeline& p) { return p.capture->GetSync()->GetWaitUs(); }));
+                uint64_t timeouts = dTimeouts(total([](MonitorPipeline& p) { return p.capture->GetSync()->GetTimeouts(); }));
+                printf("%s P:%d FPS: %3llu @ %d | %5.2f/%4.1f Mbps | V:%4llu A:%3llu S:%3llu | GPU: %4.0fus T:%llu%s | FEC:%2d/%3llu RTX:%3llu FL:%2llu | Avg: %.1f\n", st, rtcServer->GetPeerCount(), enc, fp.capture->GetCurrentFPS(), dBytes(stats.bytes) * 8.0 / 1048576.0, rtcServer->GetTargetBitrate() / 1e6, dSent(stats.sent), dAudio(rtcServer->GetAudioSent()), dStatic(staticCount), waits ? static_cast<double>(waitUs) / waits : 0.0, timeouts, readback, rtcServer->GetFecGroupSize(), dParity(rtcServer->GetParitySent()), dRtx(rtcServer->GetRetransmitted()), dLoss(rtcServer->GetLossReports()), cnt > 0 ? static_cast<double>(sum) / cnt : 0.0);
             }
         });
 
-        std::thread encodeThread([&] {
+        // Unfocused pipelines only drain their frame slot; a switch re-queues the newest converted frame instead
+        auto encodeLoop = [&](MonitorPipeline& p) {
+            ScreenCapture& capture = *p.capture;
+            FrameSlot& frameSlot = p.frameSlot;
+            auto& sendRing = p.sendRing;
+            auto& encoder = p.encoder;
+            auto& lowEncoder = p.lowEncoder;
+            std::mutex& encoderMutex = p.encoderMutex;
             SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
-            FrameData fd; bool was = false;
+            Trace::NameThread(("encode " + std::to_string(capture.GetCurrentMonitorIndex())).c_str());
+            FrameData fd; bool was = false, pendingChange = true, drainPending = false, forceKey = false;
+            int64_t stagedAt = 0;
+            std::vector<RECT> dirtyRects;
+            auto live = [&] { return rtcServer->IsConnected() && rtcServer->IsAuthenticated() && rtcServer->IsFpsReceived() && p.encoderReady && focused == &p; };
             while (running) {
-                if (!rtcServer->IsConnected() || !rtcServer->IsAuthenticated() || !rtcServer->IsFpsReceived() || !encoderReady) { std::this_thread::sleep_for(10ms); was = false; continue; }
-                if (!frameSlot.Pop(fd)) continue;
-
-                bool streaming = rtcServer->IsConnected() && rtcServer->IsAuthenticated() && rtcServer->IsFpsReceived() && encoderReady;
-                if (streaming && !was) { LOG("Streaming at %d FPS", rtcServer->GetCurrentFps()); std::lock_guard<std::mutex> lock(encoderMutex); if (encoder) encoder->Flush(); }
+                if (!live()) {
+                    capture.SetLowLayerEnabled(false);
+                    if (focused != &p && frameSlot.Pop(fd, 10)) { frameSlot.MarkReleased(fd.poolIdx); fd.Release(); }
+                    else std::this_thread::sleep_for(10ms);
+                    was = false; continue;
+                }
+                // A staged software readback is normally pushed out by the next capture; after a frame interval without
+                // one it is encoded on its own
+                int64_t drainAt = stagedAt + 1000000 / std::max(1, capture.GetCurrentFPS());
+                if (drainPending && GetTimestamp() >= drainAt) {
+                    EncodedFrame* out = sendRing.Acquire();
+                    if (!out) continue;
+                    out->stream = static_cast<uint8_t>(capture.GetCurrentMonitorIndex());
+                    std::lock_guard<std::mutex> lock(encoderMutex);
+                    if (encoder && encoder->EncodePending(*out)) { Trace::Mark(Trace::EncodeEnd, out->ts); g_encodeLatency.Observe(out->encUs); sendRing.Commit(); pendingChange = false; }
+                    drainPending = encoder && encoder->HasPending();
+                    continue;
+                }
+                if (!frameSlot.Pop(fd, drainPending ? static_cast<int>(std::clamp<int64_t>((drainAt - GetTimestamp()) / 1000, 1, 8)) : 8)) continue;
+
+                // Viewers drop another monitor's deltas, so a pipeline that just got focus opens with a keyframe
+                bool streaming = live();
+                if (streaming && !was) { LOG("Streaming monitor %d at %d FPS", capture.GetCurrentMonitorIndex(), rtcServer->GetCurrentFps()); pendingChange = forceKey = true; std::lock_guard<std::mutex> lock(encoderMutex); if (encoder) encoder->Flush(); if (lowEncoder) lowEncoder->Flush(); }
                 was = streaming;
 
                 if (!streaming || !fd.tex) { frameSlot.MarkReleased(fd.poolIdx); fd.Release(); continue; }
-                if (fd.fence > 0 && !capture.IsReady(fd.fence) && !capture.WaitReady(fd.fence)) { frameSlot.MarkReleased(fd.poolIdx); fd.Release(); continue; }
-
-                { std::lock_guard<std::mutex> lock(encoderMutex); if (encoder) if (auto* out = encoder->Encode(fd.tex, fd.ts, rtcServer->NeedsKey())) rtcServer->Send(*out); }
-                frameSlot.MarkReleased(fd.poolIdx); fd.Release();
+                if (fd.fence > 0 && !capture.IsReady(fd.fence) && !capture.WaitReady(fd.fence)) { pendingChange = true; frameSlot.MarkReleased(fd.poolIdx); fd.Release(); continue; }
+                Trace::Mark(Trace::FenceReady, fd.ts);
+
+                if (rtcServer->ShouldSkipFrame()) { pendingChange = true; frameSlot.MarkReleased(fd.poolIdx); fd.Release(); continue; }
+
+                EncodedFrame* out = sendRing.Acquire();
+                if (!out) { pendingChange = true; frameSlot.MarkReleased(fd.poolIdx); fd.Release(); continue; }
+                uint8_t stream = static_cast<uint8_t>(capture.GetCurrentMonitorIndex());
+                out->stream = stream;
+
+                bool key = rtcServer->NeedsKey(0) || forceKey, lowKey = rtcServer->NeedsKey(1) || forceKey;
+                int dirty = fd.diffed && !fd.forceDirty ? capture.ReadDirtyRegions(fd.poolIdx, dirtyRects) : -1;
+                if (dirty == 0 && !key && !lowKey && !pendingChange) { staticCount++; frameSlot.MarkReleased(fd.poolIdx); fd.Release(); continue; }
+
+                // The pool slot stays in flight until every encoder using it has released its surface
+                bool ok = false, lowOk = false;
+                {
+                    std::lock_guard<std::mutex> lock(encoderMutex);
+                    bool wantLow = lowEncoder && rtcServer->IsLayerWanted(1);
+                    capture.SetLowLayerEnabled(wantLow);
+                    // Frames captured before the convert was switched on have nothing in their low pool slice
+                    bool low = wantLow && fd.lowReady;
+                    auto release = [&frameSlot, idx = fd.poolIdx, refs = std::make_shared<std::atomic<int>>(low ? 2 : 1)] { if (--*refs == 0) frameSlot.MarkReleased(idx); };
+                    if (encoder) {
+                        encoder->SetBitrate(rtcServer->GetTargetBitrate(0));
+                        encoder->SetRegionsOfInterest(dirty > 0 && dirty < capture.GetTileCount() ? dirtyRects : std::vector<RECT>{});
+                        Trace::Mark(Trace::EncodeStart, fd.ts);
+                        ok = encoder->Encode(fd.tex, fd.poolIdx, fd.ts, key, *out, release);
+                        if (ok) { Trace::Mark(Trace::EncodeEnd, out->ts); g_encodeLatency.Observe(out->encUs); }
+                        if ((drainPending = encoder->HasPending())) stagedAt = GetTimestamp();
+                    } else release();
+                    if (ok) sendRing.Commit();
+                    if (low) {
+                        EncodedFrame* lowOut = sendRing.Acquire();
+                        if (lowOut) {
+                            lowOut->layer = 1; lowOut->stream = stream;
+                            lowEncoder->SetBitrate(rtcServer->GetTargetBitrate(1));
+                            if ((lowOk = lowEncoder->Encode(capture.GetLowPool(), fd.poolIdx, fd.ts, lowKey, *lowOut, release))) sendRing.Commit();
+                        } else release();
+                    }
+                }
+                if (ok) pendingChange = forceKey = false;
+                else if (key && !drainPending) rtcServer->RequestKeyframe(0);
+                if (lowKey && !lowOk) rtcServer->RequestKeyframe(1);
+                fd.Release();
             }
-        });
+        };
+
+        for (auto& p : pipelines) {
+            p->encodeThread = std::thread([&, p = p.get()] { encodeLoop(*p); });
+            p->sendThread = std::thread([&, p = p.get()] {
+                SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+                while (running) {
+                    if (EncodedFrame* f = p->sendRing.Peek()) { rtcServer->Send(*f); p->sendRing.Release(); }
+                }
+            });
+        }
 
         serverThread.join();
         running = false;
-        SetEvent(frameSlot.GetEvent());
-        encodeThread.join(); audioThread.join(); statsThread.join();
+        for (auto& p : pipelines) { SetEvent(p->frameSlot.GetEvent()); p->sendRing.Wake(); }
+        for (auto& p : pipelines) { p->encodeThread.join(); p->sendThread.join(); }
+        audioThread.join(); statsThread.join();
+        cursor.Stop();
         if (audioCapture) audioCapture->Stop();
         LOG("Shutdown complete");
     } catch (const std::exception& e) { ERR("Fatal: %s", e.what()); getchar(); return 1; }